@@ -0,0 +1,9 @@
+(defvar result 0)
+(defvar n 10)
+
+(defun fibonacci (n)
+  (if (<= n 1)
+    n
+    (+ (fibonacci (- n 1)) (fibonacci (- n 2)))))
+
+(setq result (fibonacci n))
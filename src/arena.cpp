@@ -0,0 +1,31 @@
+#include "arena.h"
+#include <algorithm>
+#include <cstdint>
+
+Arena::~Arena() {
+    for (auto it = destructors.rbegin(); it != destructors.rend(); ++it) {
+        it->destroy(it->obj);
+    }
+}
+
+void* Arena::allocate(const size_t size, const size_t align) {
+    auto aligned = [&] {
+        const auto addr = reinterpret_cast<uintptr_t>(cursor);
+        return reinterpret_cast<std::byte*>((addr + align - 1) & ~(align - 1));
+    };
+
+    std::byte* ptr = aligned();
+
+    if (!cursor || ptr + size > end) {
+        const size_t blockSize = std::max(BLOCK_SIZE, size + align);
+
+        blocks.emplace_back(new std::byte[blockSize]);
+        cursor = blocks.back().get();
+        end = cursor + blockSize;
+        ptr = aligned();
+    }
+
+    cursor = ptr + size;
+
+    return ptr;
+}
@@ -0,0 +1,50 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump allocator owning every AST node of a compilation. Nodes are never freed
+// one by one, everything is released at once when the arena is destroyed.
+class Arena {
+public:
+    Arena() = default;
+
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+
+    Arena& operator=(const Arena&) = delete;
+
+    template<typename T, typename... Args>
+    T* make(Args&&... args) {
+        T* obj = new(allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            destructors.push_back({obj, [](void* p) { static_cast<T*>(p)->~T(); }});
+        }
+
+        return obj;
+    }
+
+private:
+    void* allocate(size_t size, size_t align);
+
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+    struct Destructor {
+        void* obj;
+        void (*destroy)(void*);
+    };
+
+    std::vector<std::unique_ptr<std::byte[]> > blocks;
+    std::vector<Destructor> destructors;
+    std::byte* cursor{nullptr};
+    std::byte* end{nullptr};
+};
+
+#endif //ARENA_H
@@ -0,0 +1,175 @@
+#include "dce.h"
+
+static VarExpr* globalOf(const ExprPtr& expr) {
+    if (const auto defvar = cast::toDefvar(expr))
+        return cast::toVar(defvar->pair);
+    if (const auto defconst = cast::toDefconstant(expr))
+        return cast::toVar(defconst->pair);
+    return nullptr;
+}
+
+void DeadCodeEliminator::eliminate(Program& program) {
+    for (const auto& form: program.forms) {
+        if (const auto defun = cast::toDefun(form.expr)) {
+            functions[cast::toVar(defun->name)->name] = defun;
+        } else if (const auto var = globalOf(form.expr)) {
+            globals[var->name] = var;
+        }
+    }
+
+    for (const auto& form: program.forms) {
+        prune(form.expr);
+    }
+    // The values of top-level forms are discarded
+    std::erase_if(program.forms, [&](const Form& form) {
+        return !cast::toDefun(form.expr) && !globalOf(form.expr) && !hasSideEffects(form.expr);
+    });
+
+    for (const auto& form: program.forms) {
+        if (const auto var = globalOf(form.expr)) {
+            // An initializer that has to run keeps its global alive
+            if (hasSideEffects(var->value))
+                reachGlobal(var->name);
+        } else if (!cast::toDefun(form.expr)) {
+            reach(form.expr);
+        }
+    }
+
+    std::vector<Form> forms;
+    for (auto& form: program.forms) {
+        if (const auto defun = cast::toDefun(form.expr)) {
+            std::vector<ExprPtr> reached;
+            if (reachedFunctions.contains(defun))
+                reached.push_back(defun);
+            for (const auto& specialization: defun->specializations) {
+                if (reachedFunctions.contains(cast::toDefun(specialization)))
+                    reached.push_back(specialization);
+            }
+
+            if (reached.empty())
+                continue;
+
+            // The first version still in use carries the others to the code generator
+            const auto head = cast::toDefun(reached.front());
+            head->specializations.assign(reached.begin() + 1, reached.end());
+            form.expr = head;
+        } else if (const auto var = globalOf(form.expr); var && !reachedGlobals.contains(var->name)) {
+            continue;
+        }
+
+        forms.push_back(std::move(form));
+    }
+    program.forms = std::move(forms);
+}
+
+void DeadCodeEliminator::prune(const ExprPtr expr) {
+    walk(expr, [&](const ExprPtr node) {
+        switch (node->kind) {
+            case ExprKind::DEFUN: {
+                const auto defun = cast::toDefun(node);
+                pruneBody(defun->forms, true);
+
+                for (const auto& specialization: defun->specializations) {
+                    prune(specialization);
+                }
+                break;
+            }
+            case ExprKind::DOTIMES:
+                pruneBody(cast::toDotimes(node)->statements, false);
+                break;
+            case ExprKind::LET:
+                pruneBody(cast::toLet(node)->body, true);
+                break;
+            case ExprKind::WHEN:
+                pruneBody(cast::toWhen(node)->then, true);
+                break;
+            case ExprKind::COND:
+                for (auto& [test, statements]: cast::toCond(node)->variants) {
+                    pruneBody(statements, true);
+                }
+                break;
+            default:
+                break;
+        }
+    });
+}
+
+void DeadCodeEliminator::pruneBody(std::vector<ExprPtr>& body, const bool keepLast) {
+    if (body.empty()) return;
+
+    const ExprPtr last = body.back();
+    std::erase_if(body, [&](const ExprPtr& form) {
+        return !(keepLast && form == last) && !hasSideEffects(form);
+    });
+}
+
+bool DeadCodeEliminator::hasSideEffects(const ExprPtr expr) {
+    bool effect = false;
+
+    walk(expr, [&](const ExprPtr node) {
+        switch (node->kind) {
+            case ExprKind::SETQ:
+            case ExprKind::LOOP:
+            case ExprKind::RETURN:
+            case ExprKind::DEFVAR:
+            case ExprKind::DEFCONST:
+            case ExprKind::DEFUN:
+                effect = true;
+                break;
+            case ExprKind::FUNCCALL: {
+                const auto callee = calleeOf(*cast::toFuncCall(node));
+                effect = effect || !callee || hasSideEffects(*callee);
+                break;
+            }
+            default:
+                break;
+        }
+    });
+
+    return effect;
+}
+
+bool DeadCodeEliminator::hasSideEffects(const DefunExpr& defun) {
+    if (const auto it = effects.find(&defun); it != effects.end())
+        return it->second;
+
+    // Recursive calls see the function as free of side effects until its body proves otherwise
+    effects[&defun] = false;
+
+    bool effect = false;
+    for (const auto& form: defun.forms) {
+        effect = effect || hasSideEffects(form);
+    }
+
+    effects[&defun] = effect;
+    return effect;
+}
+
+void DeadCodeEliminator::reach(const ExprPtr expr) {
+    walk(expr, [&](const ExprPtr node) {
+        // The code generator reads the global of the same name for any variable without a
+        // local slot, whatever its symbol type says
+        if (const auto var = cast::toVar(node); var && globals.contains(var->name)) {
+            reachGlobal(var->name);
+        } else if (const auto funcCall = cast::toFuncCall(node)) {
+            if (const auto callee = calleeOf(*funcCall); callee && reachedFunctions.insert(callee).second)
+                reach(callee);
+        }
+    });
+}
+
+void DeadCodeEliminator::reachGlobal(const SymbolId name) {
+    if (!reachedGlobals.insert(name).second)
+        return;
+
+    if (const auto it = globals.find(name); it != globals.end())
+        reach(it->second->value);
+}
+
+DefunExpr* DeadCodeEliminator::calleeOf(const FuncCallExpr& funcCall) const {
+    if (funcCall.callee)
+        return cast::toDefun(funcCall.callee);
+
+    const auto it = functions.find(cast::toVar(funcCall.name)->name);
+    return it != functions.end() ? it->second : nullptr;
+}
@@ -0,0 +1,39 @@
+#ifndef DCE_H
+#define DCE_H
+
+#include <unordered_map>
+#include <unordered_set>
+#include "parser.h"
+
+// Runs after the folder. Forms whose value is discarded are dropped when they have no
+// side effects, then only the functions and globals reachable from the top-level code
+// are kept.
+class DeadCodeEliminator {
+public:
+    void eliminate(Program& program);
+
+private:
+    void prune(ExprPtr expr);
+
+    void pruneBody(std::vector<ExprPtr>& body, bool keepLast);
+
+    bool hasSideEffects(ExprPtr expr);
+
+    bool hasSideEffects(const DefunExpr& defun);
+
+    void reach(ExprPtr expr);
+
+    void reachGlobal(SymbolId name);
+
+    [[nodiscard]] DefunExpr* calleeOf(const FuncCallExpr& funcCall) const;
+
+    // Definitions by name
+    std::unordered_map<SymbolId, DefunExpr*> functions;
+    std::unordered_map<SymbolId, VarExpr*> globals;
+    // Functions whose side effects are decided or being decided
+    std::unordered_map<const DefunExpr*, bool> effects;
+    std::unordered_set<const DefunExpr*> reachedFunctions;
+    std::unordered_set<SymbolId> reachedGlobals;
+};
+
+#endif //DCE_H
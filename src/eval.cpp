@@ -0,0 +1,397 @@
+#include "eval.h"
+#include <limits>
+#include "recursion.h"
+
+static std::optional<Value> applyInt(const TokenType op, const int64_t lhs, const int64_t rhs) {
+    int64_t n;
+
+    // Integers are 64 bits wide at runtime and wrap around like the instructions computing them
+    switch (op) {
+        case TokenType::PLUS:
+            n = static_cast<int64_t>(static_cast<uint64_t>(lhs) + static_cast<uint64_t>(rhs));
+            break;
+        case TokenType::MINUS:
+            n = static_cast<int64_t>(static_cast<uint64_t>(lhs) - static_cast<uint64_t>(rhs));
+            break;
+        case TokenType::MUL:
+            n = static_cast<int64_t>(static_cast<uint64_t>(lhs) * static_cast<uint64_t>(rhs));
+            break;
+        case TokenType::DIV:
+            // Left to idiv, which traps at runtime
+            if (rhs == 0 || (lhs == std::numeric_limits<int64_t>::min() && rhs == -1))
+                return std::nullopt;
+            n = lhs / rhs;
+            break;
+        case TokenType::LOGAND:
+            n = lhs & rhs;
+            break;
+        case TokenType::LOGIOR:
+            n = lhs | rhs;
+            break;
+        case TokenType::LOGXOR:
+            n = lhs ^ rhs;
+            break;
+        case TokenType::LOGNOR:
+            n = ~lhs & ~rhs;
+            break;
+        case TokenType::EQUAL:
+            n = lhs == rhs;
+            break;
+        case TokenType::NEQUAL:
+            n = lhs != rhs;
+            break;
+        case TokenType::GREATER_THEN:
+            n = lhs > rhs;
+            break;
+        case TokenType::LESS_THEN:
+            n = lhs < rhs;
+            break;
+        case TokenType::GREATER_THEN_EQ:
+            n = lhs >= rhs;
+            break;
+        case TokenType::LESS_THEN_EQ:
+            n = lhs <= rhs;
+            break;
+        case TokenType::AND:
+            n = lhs != 0 && rhs != 0;
+            break;
+        case TokenType::OR:
+            n = lhs != 0 || rhs != 0;
+            break;
+        case TokenType::NOT:
+            n = lhs == 0;
+            break;
+        default:
+            return std::nullopt;
+    }
+
+    return n;
+}
+
+static std::optional<Value> applyDouble(const TokenType op, const double lhs, const double rhs) {
+    switch (op) {
+        case TokenType::PLUS:
+            return lhs + rhs;
+        case TokenType::MINUS:
+            return lhs - rhs;
+        case TokenType::MUL:
+            return lhs * rhs;
+        case TokenType::DIV:
+            return lhs / rhs;
+        case TokenType::EQUAL:
+            return int64_t{lhs == rhs};
+        case TokenType::NEQUAL:
+            return int64_t{lhs != rhs};
+        case TokenType::GREATER_THEN:
+            return int64_t{lhs > rhs};
+        case TokenType::LESS_THEN:
+            return int64_t{lhs < rhs};
+        case TokenType::GREATER_THEN_EQ:
+            return int64_t{lhs >= rhs};
+        case TokenType::LESS_THEN_EQ:
+            return int64_t{lhs <= rhs};
+        case TokenType::AND:
+            return int64_t{lhs != 0.0 && rhs != 0.0};
+        case TokenType::OR:
+            return int64_t{lhs != 0.0 || rhs != 0.0};
+        case TokenType::NOT:
+            return int64_t{lhs == 0.0};
+        default:
+            return std::nullopt;
+    }
+}
+
+static bool isNumber(const Value& value) {
+    return std::holds_alternative<int64_t>(value) || std::holds_alternative<double>(value);
+}
+
+static double toDouble(const Value& value) {
+    if (const auto n = std::get_if<int64_t>(&value))
+        return static_cast<double>(*n);
+
+    return std::get<double>(value);
+}
+
+std::optional<Value> apply(const TokenType op, const Value& lhs, const Value& rhs) {
+    if (!isNumber(lhs) || !isNumber(rhs))
+        return std::nullopt;
+
+    if (std::holds_alternative<int64_t>(lhs) && std::holds_alternative<int64_t>(rhs))
+        return applyInt(op, std::get<int64_t>(lhs), std::get<int64_t>(rhs));
+
+    return applyDouble(op, toDouble(lhs), toDouble(rhs));
+}
+
+bool Evaluator::isPure(const DefunExpr& defun) {
+    if (const auto it = purity.find(&defun); it != purity.end())
+        return it->second;
+
+    // Recursive calls see the function as pure until its body proves otherwise
+    purity[&defun] = true;
+
+    bool pure = true;
+    for (const auto& form: defun.forms) {
+        pure = pure && isPure(form);
+    }
+
+    purity[&defun] = pure;
+    return pure;
+}
+
+bool Evaluator::isPure(const ExprPtr& expr) {
+    if (!expr) return true;
+
+    return recursion::guard([&] {
+        const auto all = [&](const std::vector<ExprPtr>& body) {
+            for (const auto& form: body) {
+                if (!isPure(form)) return false;
+            }
+            return true;
+        };
+
+        switch (expr->kind) {
+            case ExprKind::BINOP: {
+                const auto binop = cast::toBinop(expr);
+                return isPure(binop->lhs) && isPure(binop->rhs);
+            }
+            case ExprKind::VAR: {
+                // Reading a defvar makes the result depend on the state of the program
+                const auto var = cast::toVar(expr);
+                return var->sType != SymbolType::GLOBAL || constants.contains(var->name);
+            }
+            case ExprKind::DOTIMES: {
+                const auto dotimes = cast::toDotimes(expr);
+                return isPure(cast::toVar(dotimes->iterationCount)->value) && all(dotimes->statements);
+            }
+            case ExprKind::LOOP:
+                return all(cast::toLoop(expr)->sexprs);
+            case ExprKind::LET: {
+                const auto let = cast::toLet(expr);
+                for (const auto& binding: let->bindings) {
+                    if (!isPure(cast::toVar(binding)->value)) return false;
+                }
+                return all(let->body);
+            }
+            case ExprKind::SETQ: {
+                const auto var = cast::toVar(cast::toSetq(expr)->pair);
+                return var->sType != SymbolType::GLOBAL && isPure(var->value);
+            }
+            case ExprKind::FUNCCALL: {
+                const auto funcCall = cast::toFuncCall(expr);
+                const auto callee = calleeOf(*funcCall);
+                if (!callee || !isPure(*callee)) return false;
+
+                for (const auto& arg: funcCall->args) {
+                    if (!isPure(cast::toVar(arg)->value)) return false;
+                }
+                return true;
+            }
+            case ExprKind::RETURN:
+                return isPure(cast::toReturn(expr)->arg);
+            case ExprKind::IF: {
+                const auto if_ = cast::toIf(expr);
+                return isPure(if_->test) && isPure(if_->then) && isPure(if_->else_);
+            }
+            case ExprKind::WHEN: {
+                const auto when = cast::toWhen(expr);
+                return isPure(when->test) && all(when->then);
+            }
+            case ExprKind::COND:
+                for (const auto& [test, statements]: cast::toCond(expr)->variants) {
+                    if (!isPure(test) || !all(statements)) return false;
+                }
+                return true;
+            case ExprKind::DEFVAR:
+            case ExprKind::DEFCONST:
+            case ExprKind::DEFUN:
+                return false;
+            default:
+                return true;
+        }
+    });
+}
+
+std::optional<Value> Evaluator::call(const DefunExpr& defun, const std::vector<Value>& args) {
+    steps = 0;
+
+    try {
+        const Value result = invoke(defun, args);
+        if (!isNumber(result))
+            return std::nullopt;
+        return result;
+    } catch (const Unfoldable&) {
+        env.clear();
+        frameBase = 0;
+        return std::nullopt;
+    }
+}
+
+const DefunExpr* Evaluator::calleeOf(const FuncCallExpr& funcCall) const {
+    if (funcCall.callee)
+        return cast::toDefun(funcCall.callee);
+
+    const auto it = functions.find(cast::toVar(funcCall.name)->name);
+    return it != functions.end() ? it->second : nullptr;
+}
+
+Value Evaluator::eval(const ExprPtr& expr) {
+    if (++steps > STEP_BUDGET)
+        throw Unfoldable{};
+
+    return recursion::guard([&]() -> Value {
+        switch (expr->kind) {
+            case ExprKind::INT:
+                return int64_t{cast::toInt(expr)->n};
+            case ExprKind::DOUBLE:
+                return cast::toDouble(expr)->n;
+            case ExprKind::BINOP:
+                return evalBinop(*cast::toBinop(expr));
+            case ExprKind::VAR: {
+                const auto var = cast::toVar(expr);
+                if (var->sType != SymbolType::GLOBAL) {
+                    const Value value = lookup(var->name);
+                    if (!isNumber(value))
+                        throw Unfoldable{};
+                    return value;
+                }
+
+                if (const auto it = constants.find(var->name); it != constants.end())
+                    return eval(it->second);
+                throw Unfoldable{};
+            }
+            case ExprKind::DOTIMES: {
+                const auto dotimes = cast::toDotimes(expr);
+                const auto counter = cast::toVar(dotimes->iterationCount);
+                const Value count = eval(counter->value);
+                if (!std::holds_alternative<int64_t>(count))
+                    throw Unfoldable{};
+
+                env.emplace_back(counter->name, int64_t{0});
+                const size_t slot = env.size() - 1;
+                for (int64_t i = 0; i < std::get<int64_t>(count); ++i) {
+                    env[slot].second = i;
+                    evalBody(dotimes->statements);
+                }
+                env.pop_back();
+                return {};
+            }
+            case ExprKind::LET: {
+                const auto let = cast::toLet(expr);
+                const size_t mark = env.size();
+                for (const auto& binding: let->bindings) {
+                    const auto var = cast::toVar(binding);
+                    // An uninitialized binding reads as garbage at runtime
+                    const Value value = var->value && !cast::toUninitialized(var->value) ? eval(var->value) : Value{};
+                    env.emplace_back(var->name, value);
+                }
+
+                Value result = evalBody(let->body);
+                env.resize(mark);
+                return result;
+            }
+            case ExprKind::SETQ: {
+                const auto var = cast::toVar(cast::toSetq(expr)->pair);
+                if (var->sType == SymbolType::GLOBAL)
+                    throw Unfoldable{};
+
+                const Value value = eval(var->value);
+                if (!isNumber(value))
+                    throw Unfoldable{};
+
+                lookup(var->name) = value;
+                return {};
+            }
+            case ExprKind::FUNCCALL: {
+                const auto funcCall = cast::toFuncCall(expr);
+                const auto callee = calleeOf(*funcCall);
+                if (!callee)
+                    throw Unfoldable{};
+
+                std::vector<Value> args;
+                args.reserve(funcCall->args.size());
+                for (const auto& arg: funcCall->args) {
+                    args.push_back(eval(cast::toVar(arg)->value));
+                }
+                return invoke(*callee, args);
+            }
+            case ExprKind::IF: {
+                const auto if_ = cast::toIf(expr);
+                if (test(if_->test))
+                    return eval(if_->then);
+                return if_->else_ ? eval(if_->else_) : Value{};
+            }
+            case ExprKind::WHEN: {
+                const auto when = cast::toWhen(expr);
+                return test(when->test) ? evalBody(when->then) : Value{};
+            }
+            case ExprKind::COND:
+                for (const auto& [test_, statements]: cast::toCond(expr)->variants) {
+                    if (test(test_))
+                        return evalBody(statements);
+                }
+                return {};
+            default:
+                // Strings, t/nil as values, loops with return
+                throw Unfoldable{};
+        }
+    });
+}
+
+Value Evaluator::evalBody(const std::vector<ExprPtr>& body) {
+    Value result;
+    for (const auto& form: body) {
+        result = eval(form);
+    }
+    return result;
+}
+
+Value Evaluator::evalBinop(const BinOpExpr& binop) {
+    const TokenType op = binop.opToken.type;
+    const Value lhs = eval(binop.lhs);
+    const Value rhs = op == TokenType::NOT ? lhs : eval(binop.rhs);
+
+    const auto result = apply(op, lhs, rhs);
+    if (!result)
+        throw Unfoldable{};
+    return *result;
+}
+
+Value Evaluator::invoke(const DefunExpr& defun, const std::vector<Value>& args) {
+    const size_t mark = env.size();
+    const size_t callerBase = frameBase;
+
+    for (size_t i = 0; i < args.size(); ++i) {
+        const auto param = cast::toVar(defun.args[i]);
+        // Arguments are passed in the register class of the parameter
+        if (!isNumber(args[i]) || std::holds_alternative<double>(args[i]) != (param->vType == VarType::DOUBLE))
+            throw Unfoldable{};
+        env.emplace_back(param->name, args[i]);
+    }
+    frameBase = mark;
+
+    const Value result = evalBody(defun.forms);
+
+    env.resize(mark);
+    frameBase = callerBase;
+    return result;
+}
+
+bool Evaluator::test(const ExprPtr& expr) {
+    if (cast::toT(expr))
+        return true;
+    if (cast::toNIL(expr))
+        return false;
+
+    const Value value = eval(expr);
+    if (!isNumber(value))
+        throw Unfoldable{};
+    return toDouble(value) != 0.0;
+}
+
+Value& Evaluator::lookup(const SymbolId name) {
+    for (size_t i = env.size(); i > frameBase; --i) {
+        if (env[i - 1].first == name)
+            return env[i - 1].second;
+    }
+    throw Unfoldable{};
+}
@@ -0,0 +1,62 @@
+#ifndef EVAL_H
+#define EVAL_H
+
+#include <optional>
+#include <unordered_map>
+#include <variant>
+#include "parser.h"
+
+// A runtime value during compile-time evaluation; monostate stands for forms without a value
+using Value = std::variant<std::monostate, int64_t, double>;
+
+// Result of a binary operation on two values, or nothing when it has to be left for runtime
+std::optional<Value> apply(TokenType op, const Value& lhs, const Value& rhs);
+
+// Interprets calls to pure functions whose arguments are all known at compile time.
+// Evaluation gives up on anything it cannot reproduce exactly as the generated code
+// would compute it, and after a fixed number of steps.
+class Evaluator {
+public:
+    Evaluator(const std::unordered_map<SymbolId, ExprPtr>& constants,
+              const std::unordered_map<SymbolId, DefunExpr*>& functions) : constants(constants),
+                                                                          functions(functions) {
+    }
+
+    [[nodiscard]] bool isPure(const DefunExpr& defun);
+
+    std::optional<Value> call(const DefunExpr& defun, const std::vector<Value>& args);
+
+    [[nodiscard]] const DefunExpr* calleeOf(const FuncCallExpr& funcCall) const;
+
+private:
+    [[nodiscard]] bool isPure(const ExprPtr& expr);
+
+    Value eval(const ExprPtr& expr);
+
+    Value evalBody(const std::vector<ExprPtr>& body);
+
+    Value evalBinop(const BinOpExpr& binop);
+
+    Value invoke(const DefunExpr& defun, const std::vector<Value>& args);
+
+    bool test(const ExprPtr& expr);
+
+    Value& lookup(SymbolId name);
+
+    // Thrown to abandon an evaluation
+    struct Unfoldable {
+    };
+
+    static constexpr uint64_t STEP_BUDGET = 1'000'000;
+
+    // Bindings of the active calls; lookups only see the ones above frameBase
+    std::vector<std::pair<SymbolId, Value> > env;
+    size_t frameBase{};
+    uint64_t steps{};
+    // Functions whose purity is decided or being decided
+    std::unordered_map<const DefunExpr*, bool> purity;
+    const std::unordered_map<SymbolId, ExprPtr>& constants;
+    const std::unordered_map<SymbolId, DefunExpr*>& functions;
+};
+
+#endif //EVAL_H
@@ -8,6 +8,7 @@
 /* Syntax Errors */
 constexpr const char* MISSING_PAREN_ERROR = "Missing parenthesis";
 constexpr const char* EXPECTED_NUMBER_ERROR = "Expected int or double";
+constexpr const char* NUMBER_RANGE_ERROR = "The number '{}' is out of range";
 constexpr const char* SEXPR_ERROR = "S-expression is not allowed here";
 constexpr const char* EXPECTED_ELEMS_NUMBER_ERROR = "Too few elements in '{}'";
 constexpr const char* OP_INVALID_NUMBER_OF_ARGS_ERROR =
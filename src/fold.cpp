@@ -0,0 +1,339 @@
+#include "fold.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "recursion.h"
+
+static Value valueOf(const ExprPtr& literal) {
+    if (const auto int_ = cast::toInt(literal))
+        return int64_t{int_->n};
+
+    return cast::toDouble(literal)->n;
+}
+
+static bool isTrue(const ExprPtr& literal) {
+    if (const auto int_ = cast::toInt(literal))
+        return int_->n != 0;
+
+    return cast::toDouble(literal)->n != 0.0;
+}
+
+static size_t sizeOf(const IExpr* expr) {
+    size_t size = 0;
+    walk(expr, [&](const IExpr*) { ++size; });
+    return size;
+}
+
+// Whether a parameter is assigned or shadowed anywhere in the body, so that not every
+// reference to its name reads the argument
+static bool isRebound(const DefunExpr& defun, const SymbolId param) {
+    bool rebound = false;
+    const auto binds = [&](const IExpr* var) { rebound = rebound || cast::toVar(var)->name == param; };
+
+    walk(&defun, [&](const IExpr* expr) {
+        if (const auto setq = cast::toSetq(expr)) {
+            binds(setq->pair);
+        } else if (const auto let = cast::toLet(expr)) {
+            std::ranges::for_each(let->bindings, binds);
+        } else if (const auto dotimes = cast::toDotimes(expr)) {
+            binds(dotimes->iterationCount);
+        }
+    });
+    return rebound;
+}
+
+void ConstantFolder::fold(Program& program) {
+    size_t size = 0;
+    for (const auto& form: program.forms) {
+        size += sizeOf(form.expr);
+    }
+    growthLimit = std::max(MIN_GROWTH_LIMIT, size);
+
+    for (auto& form: program.forms) {
+        foldExpr(form.expr);
+        form.kind = form.expr->kind;
+    }
+}
+
+void ConstantFolder::foldExpr(ExprPtr& expr) {
+    if (!expr) return;
+
+    recursion::guard([&] {
+        switch (expr->kind) {
+            case ExprKind::BINOP: {
+                const auto binop = cast::toBinop(expr);
+                foldExpr(binop->lhs);
+                foldExpr(binop->rhs);
+
+                if (const auto result = evaluate(*binop, false))
+                    expr = result;
+                break;
+            }
+            case ExprKind::VAR:
+                if (const auto value = constantOf(expr))
+                    expr = value;
+                break;
+            case ExprKind::DOTIMES: {
+                const auto dotimes = cast::toDotimes(expr);
+                foldBinding(dotimes->iterationCount);
+                foldBody(dotimes->statements);
+                break;
+            }
+            case ExprKind::LOOP:
+                foldBody(cast::toLoop(expr)->sexprs);
+                break;
+            case ExprKind::LET: {
+                const auto let = cast::toLet(expr);
+                for (const auto& binding: let->bindings) {
+                    foldBinding(binding);
+                }
+                foldBody(let->body);
+                break;
+            }
+            case ExprKind::SETQ:
+                foldBinding(cast::toSetq(expr)->pair);
+                break;
+            case ExprKind::DEFVAR:
+                foldBinding(cast::toDefvar(expr)->pair);
+                break;
+            case ExprKind::DEFCONST: {
+                const auto var = cast::toVar(cast::toDefconstant(expr)->pair);
+                foldBinding(var);
+
+                if (cast::toInt(var->value) || cast::toDouble(var->value))
+                    constants[var->name] = var->value;
+                break;
+            }
+            case ExprKind::DEFUN: {
+                const auto defun = cast::toDefun(expr);
+                functions[cast::toVar(defun->name)->name] = defun;
+                owners[defun] = defun;
+                foldBody(defun->forms);
+
+                // Clones made while folding are appended here and come out folded already
+                for (size_t i = 0, n = defun->specializations.size(); i < n; ++i) {
+                    const auto specialization = cast::toDefun(defun->specializations[i]);
+                    owners[specialization] = defun;
+                    foldBody(specialization->forms);
+                }
+                break;
+            }
+            case ExprKind::FUNCCALL: {
+                const auto funcCall = cast::toFuncCall(expr);
+                for (const auto& arg: funcCall->args) {
+                    foldBinding(arg);
+                }
+
+                if (const auto result = evaluate(*funcCall)) {
+                    expr = result;
+                } else {
+                    specialize(*funcCall);
+                }
+                break;
+            }
+            case ExprKind::RETURN:
+                foldExpr(cast::toReturn(expr)->arg);
+                break;
+            case ExprKind::IF: {
+                const auto if_ = cast::toIf(expr);
+                foldTest(if_->test);
+                foldExpr(if_->then);
+                foldExpr(if_->else_);
+
+                if (cast::toT(if_->test)) {
+                    expr = if_->then;
+                } else if (cast::toNIL(if_->test) && if_->else_) {
+                    expr = if_->else_;
+                }
+                break;
+            }
+            case ExprKind::WHEN: {
+                const auto when = cast::toWhen(expr);
+                foldTest(when->test);
+                foldBody(when->then);
+                break;
+            }
+            case ExprKind::COND: {
+                auto& variants = cast::toCond(expr)->variants;
+                for (auto& [test, statements]: variants) {
+                    foldTest(test);
+                    foldBody(statements);
+                }
+
+                // Arms behind a nil test never run, and neither does anything after a t test
+                std::erase_if(variants, [](const auto& variant) { return cast::toNIL(variant.first); });
+                const auto taken = std::ranges::find_if(variants, [](const auto& variant) {
+                    return cast::toT(variant.first);
+                });
+                if (taken != variants.end())
+                    variants.erase(taken + 1, variants.end());
+
+                if (!variants.empty() && cast::toT(variants.front().first) && variants.front().second.size() == 1)
+                    expr = variants.front().second.front();
+                break;
+            }
+            default:
+                break;
+        }
+    });
+}
+
+void ConstantFolder::foldTest(ExprPtr& test) {
+    // A constant test turns into t or nil, which the code generator resolves to a plain jump
+    if (const auto binop = cast::toBinop(test)) {
+        foldExpr(binop->lhs);
+        foldExpr(binop->rhs);
+
+        if (const auto result = evaluate(*binop, true)) {
+            test = result;
+        }
+    } else if (const auto value = cast::toVar(test) ? constantOf(test) : nullptr) {
+        test = isTrue(value) ? static_cast<ExprPtr>(arena.make<TExpr>()) : arena.make<NILExpr>();
+    } else {
+        const bool isCall = cast::toFuncCall(test);
+        foldExpr(test);
+
+        if (isCall && constantOf(test))
+            test = isTrue(test) ? static_cast<ExprPtr>(arena.make<TExpr>()) : arena.make<NILExpr>();
+    }
+}
+
+void ConstantFolder::foldBody(std::vector<ExprPtr>& body) {
+    for (auto& form: body) {
+        foldExpr(form);
+    }
+}
+
+void ConstantFolder::foldBinding(const ExprPtr& var) {
+    if (const auto var_ = cast::toVar(var)) {
+        foldExpr(var_->value);
+    }
+}
+
+ExprPtr ConstantFolder::evaluate(const BinOpExpr& binop, const bool isTest) const {
+    const TokenType op = binop.opToken.type;
+    const ExprPtr lhs = constantOf(binop.lhs);
+    const ExprPtr rhs = op == TokenType::NOT ? lhs : constantOf(binop.rhs);
+
+    if (!lhs || !rhs)
+        return nullptr;
+
+    const auto result = apply(op, valueOf(lhs), valueOf(rhs));
+    if (!result)
+        return nullptr;
+
+    if (isTest) {
+        const bool isTrue = std::holds_alternative<int64_t>(*result)
+                                ? std::get<int64_t>(*result) != 0
+                                : std::get<double>(*result) != 0.0;
+        return isTrue ? static_cast<ExprPtr>(arena.make<TExpr>()) : arena.make<NILExpr>();
+    }
+
+    return literalOf(*result);
+}
+
+ExprPtr ConstantFolder::evaluate(const FuncCallExpr& funcCall) {
+    const auto callee = evaluator.calleeOf(funcCall);
+    if (!callee || !evaluator.isPure(*callee))
+        return nullptr;
+
+    std::vector<Value> args;
+    args.reserve(funcCall.args.size());
+    for (const auto& arg: funcCall.args) {
+        const ExprPtr value = constantOf(cast::toVar(arg)->value);
+        if (!value)
+            return nullptr;
+        args.push_back(valueOf(value));
+    }
+
+    const auto result = evaluator.call(*callee, args);
+    // The caller reads the result from xmm0 or rax depending on the inferred return type
+    if (!result || std::holds_alternative<double>(*result) != static_cast<bool>(cast::toDouble(callee->returnType)))
+        return nullptr;
+
+    return literalOf(*result);
+}
+
+void ConstantFolder::specialize(FuncCallExpr& funcCall) {
+    const auto callee = evaluator.calleeOf(funcCall);
+    if (!callee || callee->args.size() != funcCall.args.size())
+        return;
+
+    // References to parameters passed on the stack are addressed by their position
+    if (std::ranges::any_of(callee->args, [](const ExprPtr& arg) { return cast::toVar(arg)->sType != SymbolType::LOCAL; }))
+        return;
+
+    std::vector<std::pair<size_t, Value> > constantArgs;
+    for (size_t i = 0; i < funcCall.args.size(); ++i) {
+        const ExprPtr value = constantOf(cast::toVar(funcCall.args[i])->value);
+        const auto double_ = cast::toDouble(value);
+        if (!value || (double_ && std::isnan(double_->n)) || isRebound(*callee, cast::toVar(callee->args[i])->name))
+            continue;
+        constantArgs.emplace_back(i, valueOf(value));
+    }
+
+    // Calls with nothing or everything known are left to the code generator and evaluate()
+    if (constantArgs.empty() || constantArgs.size() == funcCall.args.size())
+        return;
+
+    auto key = std::make_pair(static_cast<const DefunExpr*>(callee), constantArgs);
+    DefunExpr* residual;
+    if (const auto it = clones.find(key); it != clones.end()) {
+        residual = it->second;
+    } else {
+        const size_t size = sizeOf(callee);
+        if (growth + size > growthLimit)
+            return;
+        growth += size;
+
+        residual = cast::toDefun(clone(arena, callee));
+        const auto name = cast::toVar(residual->name);
+        name->name = symbol::intern(symbol::name(name->name) + ".c" + std::to_string(clones.size()));
+        clones.emplace(std::move(key), residual);
+
+        const auto owner = owners.at(callee);
+        owner->specializations.push_back(residual);
+        owners[residual] = owner;
+
+        auto outer = std::move(arguments);
+        arguments = {};
+        for (auto it = constantArgs.rbegin(); it != constantArgs.rend(); ++it) {
+            arguments[cast::toVar(residual->args[it->first])->name] = literalOf(it->second);
+            residual->args.erase(residual->args.begin() + static_cast<long>(it->first));
+        }
+
+        foldBody(residual->forms);
+        arguments = std::move(outer);
+    }
+
+    for (auto it = constantArgs.rbegin(); it != constantArgs.rend(); ++it) {
+        funcCall.args.erase(funcCall.args.begin() + static_cast<long>(it->first));
+    }
+    funcCall.callee = residual;
+}
+
+ExprPtr ConstantFolder::literalOf(const Value& value) const {
+    // Integer literals hold an int, larger results stay a runtime computation
+    if (const auto n = std::get_if<int64_t>(&value)) {
+        if (*n < std::numeric_limits<int>::min() || *n > std::numeric_limits<int>::max())
+            return nullptr;
+        return arena.make<IntExpr>(static_cast<int>(*n));
+    }
+
+    return arena.make<DoubleExpr>(std::get<double>(value));
+}
+
+ExprPtr ConstantFolder::constantOf(const ExprPtr& expr) const {
+    if (cast::toInt(expr) || cast::toDouble(expr))
+        return expr;
+
+    if (const auto var = cast::toVar(expr); var && var->sType == SymbolType::GLOBAL) {
+        if (const auto it = constants.find(var->name); it != constants.end())
+            return it->second;
+    } else if (var) {
+        if (const auto it = arguments.find(var->name); it != arguments.end())
+            return it->second;
+    }
+
+    return nullptr;
+}
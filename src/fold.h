@@ -0,0 +1,60 @@
+#ifndef FOLD_H
+#define FOLD_H
+
+#include <map>
+#include <unordered_map>
+#include "eval.h"
+#include "parser.h"
+
+// Runs between the semantic analyzer and the code generator. Operations on literals
+// are replaced by their result and defconstant values are propagated into their uses,
+// so folded defvar/defconstant initializers end up in .data/.rodata. Calls to pure
+// functions with constant arguments are evaluated and replaced by their result, and
+// calls passing some constant arguments go to a clone of the function specialized on them.
+class ConstantFolder {
+public:
+    explicit ConstantFolder(Arena& arena) : arena(arena) {
+    }
+
+    void fold(Program& program);
+
+private:
+    void foldExpr(ExprPtr& expr);
+
+    void foldTest(ExprPtr& test);
+
+    void foldBody(std::vector<ExprPtr>& body);
+
+    void foldBinding(const ExprPtr& var);
+
+    [[nodiscard]] ExprPtr evaluate(const BinOpExpr& binop, bool isTest) const;
+
+    ExprPtr evaluate(const FuncCallExpr& funcCall);
+
+    void specialize(FuncCallExpr& funcCall);
+
+    // Literal holding a value, none for integers an IntExpr cannot hold
+    [[nodiscard]] ExprPtr literalOf(const Value& value) const;
+
+    [[nodiscard]] ExprPtr constantOf(const ExprPtr& expr) const;
+
+    // Literal values of defconstants by name
+    std::unordered_map<SymbolId, ExprPtr> constants;
+    // Definitions seen so far by name
+    std::unordered_map<SymbolId, DefunExpr*> functions;
+    Evaluator evaluator{constants, functions};
+    // Constant parameters of the clone being folded
+    std::unordered_map<SymbolId, ExprPtr> arguments;
+    // Clones by function and constant arguments
+    std::map<std::pair<const DefunExpr*, std::vector<std::pair<size_t, Value> > >, DefunExpr*> clones;
+    // Top-level definition each function or clone is emitted with
+    std::unordered_map<const DefunExpr*, DefunExpr*> owners;
+    // Nodes added by clones so far, and how many the program may grow by
+    static constexpr size_t MIN_GROWTH_LIMIT = 256;
+    size_t growth{};
+    size_t growthLimit{};
+    // AST Nodes
+    Arena& arena;
+};
+
+#endif //FOLD_H
@@ -0,0 +1,124 @@
+#include "ir.h"
+#include <algorithm>
+
+namespace ir {
+bool isTerminator(const Opcode op) {
+    return op == Opcode::BR || op == Opcode::CBR || op == Opcode::RET;
+}
+
+std::vector<BlockId> successors(const Block& block) {
+    if (block.instrs.empty() || !isTerminator(block.instrs.back().op))
+        return {};
+
+    return block.instrs.back().targets;
+}
+
+void computePreds(Function& fn) {
+    for (auto& block: fn.blocks) {
+        block.preds.clear();
+    }
+
+    for (BlockId id = 0; id < fn.blocks.size(); ++id) {
+        for (const BlockId succ: successors(fn.blocks[id])) {
+            auto& preds = fn.blocks[succ].preds;
+            if (std::ranges::find(preds, id) == preds.end())
+                preds.push_back(id);
+        }
+    }
+}
+
+void removeUnreachable(Function& fn) {
+    std::vector<bool> reached(fn.blocks.size());
+    std::vector<BlockId> worklist{0};
+    reached[0] = true;
+
+    while (!worklist.empty()) {
+        const BlockId id = worklist.back();
+        worklist.pop_back();
+
+        for (const BlockId succ: successors(fn.blocks[id])) {
+            if (!reached[succ]) {
+                reached[succ] = true;
+                worklist.push_back(succ);
+            }
+        }
+    }
+
+    std::vector<BlockId> renumbered(fn.blocks.size());
+    std::vector<Block> blocks;
+    for (BlockId id = 0; id < fn.blocks.size(); ++id) {
+        if (reached[id]) {
+            renumbered[id] = blocks.size();
+            blocks.push_back(std::move(fn.blocks[id]));
+        }
+    }
+
+    for (auto& block: blocks) {
+        for (auto& instr: block.instrs) {
+            if (instr.op == Opcode::PHI) {
+                // Incoming values from blocks that are gone
+                for (size_t i = instr.targets.size(); i-- > 0;) {
+                    if (!reached[instr.targets[i]]) {
+                        instr.targets.erase(instr.targets.begin() + static_cast<long>(i));
+                        instr.args.erase(instr.args.begin() + static_cast<long>(i));
+                    }
+                }
+            }
+
+            for (auto& target: instr.targets) {
+                target = renumbered[target];
+            }
+        }
+    }
+
+    fn.blocks = std::move(blocks);
+    computePreds(fn);
+}
+
+void removeDeadValues(Function& fn) {
+    const auto hasSideEffects = [](const Instr& instr) {
+        switch (instr.op) {
+            case Opcode::STORE:
+            case Opcode::CALL:
+            case Opcode::BR:
+            case Opcode::CBR:
+            case Opcode::RET:
+                return true;
+            default:
+                return false;
+        }
+    };
+
+    // Values are live when an instruction with side effects reads them, directly or
+    // through other live values; phis reading each other in a loop are not enough
+    std::vector<const Instr*> defs(fn.values.size());
+    std::vector<bool> isLive(fn.values.size());
+    std::vector<Value> worklist;
+
+    for (const auto& block: fn.blocks) {
+        for (const auto& instr: block.instrs) {
+            if (instr.dst != NONE)
+                defs[instr.dst] = &instr;
+            if (hasSideEffects(instr))
+                worklist.insert(worklist.end(), instr.args.begin(), instr.args.end());
+        }
+    }
+
+    while (!worklist.empty()) {
+        const Value value = worklist.back();
+        worklist.pop_back();
+        if (isLive[value])
+            continue;
+
+        isLive[value] = true;
+        if (defs[value])
+            worklist.insert(worklist.end(), defs[value]->args.begin(), defs[value]->args.end());
+    }
+
+    for (auto& block: fn.blocks) {
+        std::erase_if(block.instrs, [&](const Instr& instr) {
+            return !hasSideEffects(instr) && instr.dst != NONE && !isLive[instr.dst];
+        });
+    }
+}
+}
@@ -0,0 +1,138 @@
+#ifndef IR_H
+#define IR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "symbol.h"
+
+// Typed three-address code in SSA form. Every instruction defines at most one value,
+// values are numbered per function and defined exactly once; control flow merges
+// through phi instructions at the head of a block.
+namespace ir {
+enum class Type : uint8_t {
+    VOID,
+    I64,
+    F64
+};
+
+enum class Opcode : uint8_t {
+    // dst = imm/fimm
+    CONST,
+    // dst = address of the global symbol
+    ADDR,
+    // dst = incoming parameter imm
+    PARAM,
+    // dst = args[0] op args[1]
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    AND,
+    OR,
+    XOR,
+    // dst = args[0] cond args[1] ? 1 : 0, compared as the type of the operands
+    CMP,
+    // dst = args[0] converted between integer and double, doubles are truncated
+    CVT,
+    // dst = stack slot or global
+    LOAD,
+    // stack slot or global = args[0]
+    STORE,
+    // dst = symbol(args...)
+    CALL,
+    // dst = args[i] when control came from targets[i]
+    PHI,
+    // goto targets[0]
+    BR,
+    // goto args[0] != 0 ? targets[0] : targets[1]
+    CBR,
+    // return args[0], if any
+    RET
+};
+
+enum class Cond : uint8_t {
+    EQ,
+    NE,
+    LT,
+    GT,
+    LE,
+    GE
+};
+
+using Value = uint32_t;
+using BlockId = uint32_t;
+
+inline constexpr Value NONE = 0;
+
+struct Instr {
+    Opcode op;
+    Type type{Type::VOID};
+    Value dst{NONE};
+    std::vector<Value> args{};
+    Cond cond{};
+    int64_t imm{};
+    double fimm{};
+    // Global of LOAD/STORE/ADDR, callee of CALL
+    SymbolId symbol{};
+    // Stack slot of LOAD/STORE, -1 when the location is a global
+    int32_t slot{-1};
+    std::vector<BlockId> targets{};
+};
+
+struct Block {
+    std::vector<Instr> instrs;
+    std::vector<BlockId> preds;
+};
+
+struct Function {
+    SymbolId name;
+    // The program entry, which exits instead of returning
+    bool isEntry{false};
+    std::vector<Type> params{};
+    Type returnType{Type::I64};
+    // blocks[0] is the entry block
+    std::vector<Block> blocks{};
+    // Type of every value, values[NONE] is unused
+    std::vector<Type> values{Type::VOID};
+    // Type of every stack slot
+    std::vector<Type> slots{};
+};
+
+struct Global {
+    enum class Section : uint8_t {
+        DATA,
+        RODATA,
+        BSS
+    };
+
+    SymbolId name;
+    Section section;
+    Type type{Type::I64};
+    int64_t imm{};
+    double fimm{};
+    // Strings live in the section themselves, their uses take the address
+    bool isString{false};
+    std::string str{};
+};
+
+struct Module {
+    std::vector<Function> functions;
+    std::vector<Global> globals;
+};
+
+bool isTerminator(Opcode op);
+
+std::vector<BlockId> successors(const Block& block);
+
+// Recomputes the predecessors of every block
+void computePreds(Function& fn);
+
+// Drops blocks control never reaches and renumbers the rest in order
+void removeUnreachable(Function& fn);
+
+// Drops instructions without side effects whose value is never used
+void removeDeadValues(Function& fn);
+}
+
+#endif //IR_H
@@ -0,0 +1,704 @@
+#include "irgen.h"
+#include <optional>
+#include "mem2reg.h"
+#include "recursion.h"
+
+using ir::Opcode;
+using ir::Type;
+
+static std::optional<ir::Cond> condOf(const TokenType type) {
+    switch (type) {
+        case TokenType::EQUAL:
+            return ir::Cond::EQ;
+        case TokenType::NEQUAL:
+            return ir::Cond::NE;
+        case TokenType::LESS_THEN:
+            return ir::Cond::LT;
+        case TokenType::GREATER_THEN:
+            return ir::Cond::GT;
+        case TokenType::LESS_THEN_EQ:
+            return ir::Cond::LE;
+        case TokenType::GREATER_THEN_EQ:
+            return ir::Cond::GE;
+        default:
+            return std::nullopt;
+    }
+}
+
+static Type typeOfVar(const VarType type) {
+    return type == VarType::DOUBLE ? Type::F64 : Type::I64;
+}
+
+// The function and its callers agree on the register of the result through the analyzer's type
+static Type returnTypeOf(const DefunExpr* defun) {
+    return defun && cast::toDouble(defun->returnType) ? Type::F64 : Type::I64;
+}
+
+// Sethi–Ullman number of an operand: integer constants end up as immediates, other
+// leaves take a register, and a tree needs one more than its sides only when they need
+// the same. Forms other than arithmetic over leaves may have effects and get -1.
+int IRGen::registerNeed(const IExpr* expr) {
+    if (!expr) return 0;
+
+    switch (expr->kind) {
+        case ExprKind::INT:
+        case ExprKind::T:
+        case ExprKind::NIL:
+            return 0;
+        case ExprKind::DOUBLE:
+        case ExprKind::STRING:
+        case ExprKind::VAR:
+            return 1;
+        case ExprKind::BINOP:
+            return recursion::guard([&] {
+                const auto binop = cast::toBinop(expr);
+                if (const auto it = registerNeeds.find(binop); it != registerNeeds.end())
+                    return it->second;
+
+                const int lhs = registerNeed(binop->lhs);
+                const int rhs = registerNeed(binop->rhs);
+                const int need = lhs < 0 || rhs < 0 ? -1 : lhs == rhs ? lhs + 1 : std::max(lhs, rhs);
+                registerNeeds.emplace(binop, need);
+                return need;
+            });
+        default:
+            return -1;
+    }
+}
+
+ir::Module IRGen::generate(const Program& program) {
+    std::vector<const DefunExpr*> defuns;
+    for (const auto& form: program.forms) {
+        if (const auto defun = cast::toDefun(form.expr)) {
+            defuns.push_back(defun);
+            functions[cast::toVar(defun->name)->name] = defun;
+
+            for (const auto& specialization: defun->specializations) {
+                defuns.push_back(cast::toDefun(specialization));
+            }
+        }
+    }
+
+    module.functions.push_back({.name = symbol::intern("_start"), .isEntry = true});
+    fn = &module.functions.back();
+    setBlock(createBlock());
+
+    for (const auto& form: program.forms) {
+        if (!cast::toDefun(form.expr))
+            genExpr(form.expr);
+    }
+    emit({.op = Opcode::RET});
+
+    for (const auto defun: defuns) {
+        genFunction(*defun);
+    }
+
+    for (auto& function: module.functions) {
+        ir::removeUnreachable(function);
+
+        SlotPromoter promoter;
+        promoter.promote(function);
+
+        ir::removeDeadValues(function);
+    }
+
+    return std::move(module);
+}
+
+void IRGen::genGlobal(const VarExpr& var, const bool isConstant) {
+    const auto section = isConstant ? ir::Global::Section::RODATA : ir::Global::Section::DATA;
+    ir::Global global{.name = var.name, .section = section};
+
+    const ExprPtr value = var.value;
+    ir::Value computed = ir::NONE;
+
+    if (const auto int_ = cast::toInt(value)) {
+        global.imm = int_->n;
+    } else if (const auto double_ = cast::toDouble(value)) {
+        global.type = Type::F64;
+        global.fimm = double_->n;
+    } else if (cast::toT(value) || cast::toNIL(value)) {
+        global.imm = cast::toT(value) != nullptr;
+    } else if (const auto str = cast::toString(value)) {
+        global.section = ir::Global::Section::RODATA;
+        global.isString = true;
+        global.str = str->data;
+    } else {
+        // Computed at startup, in the order of the program
+        global.section = ir::Global::Section::BSS;
+        global.type = typeOfVar(var.vType);
+
+        if (!cast::toUninitialized(value))
+            computed = genExpr(value);
+    }
+
+    globals[var.name] = module.globals.size();
+    module.globals.push_back(std::move(global));
+
+    if (computed != ir::NONE)
+        genStore(var, computed);
+}
+
+void IRGen::genFunction(const DefunExpr& defun) {
+    module.functions.push_back({.name = cast::toVar(defun.name)->name});
+    fn = &module.functions.back();
+    setBlock(createBlock());
+
+    for (size_t i = 0; i < defun.args.size(); ++i) {
+        const auto param = cast::toVar(defun.args[i]);
+        const Type type = typeOfVar(param->vType);
+        fn->params.push_back(type);
+
+        const ir::Value value = emit({.op = Opcode::PARAM, .type = type, .imm = static_cast<int64_t>(i)});
+        emit({.op = Opcode::STORE, .args = {value}, .slot = bind(param->name, type)});
+    }
+
+    ir::Value result = genBody(defun.forms);
+
+    fn->returnType = returnTypeOf(&defun);
+
+    result = convert(result ? result : zero(fn->returnType), fn->returnType);
+    emit({.op = Opcode::RET, .args = {result}});
+
+    locals.clear();
+}
+
+ir::Value IRGen::genExpr(const ExprPtr expr) {
+    if (!expr) return ir::NONE;
+    return recursion::guard([&]() -> ir::Value {
+        switch (expr->kind) {
+            case ExprKind::INT:
+                return constant(cast::toInt(expr)->n);
+            case ExprKind::DOUBLE:
+                return constantDouble(cast::toDouble(expr)->n);
+            case ExprKind::T:
+                return constant(1);
+            case ExprKind::NIL:
+                return constant(0);
+            case ExprKind::STRING:
+                return genString(cast::toString(expr)->data);
+            case ExprKind::VAR:
+                return genLoad(*cast::toVar(expr));
+            case ExprKind::BINOP:
+                return genBinop(*cast::toBinop(expr));
+            case ExprKind::DOTIMES:
+                return genDotimes(*cast::toDotimes(expr));
+            case ExprKind::LOOP:
+                return genLoop(*cast::toLoop(expr));
+            case ExprKind::LET:
+                return genLet(*cast::toLet(expr));
+            case ExprKind::SETQ:
+                return genSetq(*cast::toSetq(expr));
+            case ExprKind::DEFVAR:
+                genGlobal(*cast::toVar(cast::toDefvar(expr)->pair), false);
+                break;
+            case ExprKind::DEFCONST:
+                genGlobal(*cast::toVar(cast::toDefconstant(expr)->pair), true);
+                break;
+            case ExprKind::FUNCCALL:
+                return genFuncCall(*cast::toFuncCall(expr));
+            case ExprKind::RETURN:
+                genReturn();
+                break;
+            case ExprKind::IF:
+                return genIf(*cast::toIf(expr));
+            case ExprKind::WHEN:
+                return genWhen(*cast::toWhen(expr));
+            case ExprKind::COND:
+                return genCond(*cast::toCond(expr));
+            default:
+                break;
+        }
+
+        return ir::NONE;
+    });
+}
+
+ir::Value IRGen::genBody(const std::vector<ExprPtr>& body) {
+    ir::Value result = ir::NONE;
+
+    for (const auto& form: body) {
+        result = genExpr(form);
+    }
+
+    return result;
+}
+
+ir::Value IRGen::genOperand(const ExprPtr expr) {
+    const ir::Value value = genExpr(expr);
+    return value ? value : constant(0);
+}
+
+ir::Value IRGen::genBinop(const BinOpExpr& binop) {
+    switch (binop.opToken.type) {
+        case TokenType::PLUS:
+            return genArith(Opcode::ADD, binop.lhs, binop.rhs);
+        case TokenType::MINUS:
+            return genArith(Opcode::SUB, binop.lhs, binop.rhs);
+        case TokenType::MUL:
+            return genArith(Opcode::MUL, binop.lhs, binop.rhs);
+        case TokenType::DIV:
+            return genArith(Opcode::DIV, binop.lhs, binop.rhs);
+        case TokenType::LOGAND:
+            return genArith(Opcode::AND, binop.lhs, binop.rhs);
+        case TokenType::LOGIOR:
+            return genArith(Opcode::OR, binop.lhs, binop.rhs);
+        case TokenType::LOGXOR:
+            return genArith(Opcode::XOR, binop.lhs, binop.rhs);
+        case TokenType::LOGNOR: {
+            // Bitwise NOT of each side separately
+            const auto [a, b] = genOperands(binop.lhs, binop.rhs);
+            const ir::Value lhs = emit({.op = Opcode::XOR, .type = Type::I64, .args = {a, constant(-1)}});
+            const ir::Value rhs = emit({.op = Opcode::XOR, .type = Type::I64, .args = {b, constant(-1)}});
+            return emit({.op = Opcode::AND, .type = Type::I64, .args = {lhs, rhs}});
+        }
+        default:
+            return genLogic(binop);
+    }
+}
+
+std::pair<ir::Value, ir::Value> IRGen::genOperands(const ExprPtr lhs, const ExprPtr rhs) {
+    // The side needing more registers goes first, so that the other one is evaluated
+    // while only its result is held; the operands keep their places either way
+    const int lhsNeed = registerNeed(lhs);
+    const int rhsNeed = registerNeed(rhs);
+    if (lhsNeed >= 0 && rhsNeed > lhsNeed) {
+        const ir::Value b = genOperand(rhs);
+        return {genOperand(lhs), b};
+    }
+
+    const ir::Value a = genOperand(lhs);
+    return {a, genOperand(rhs)};
+}
+
+ir::Value IRGen::genArith(const Opcode op, const ExprPtr lhs, const ExprPtr rhs) {
+    auto [a, b] = genOperands(lhs, rhs);
+
+    const Type type = typeOf(a) == Type::F64 || typeOf(b) == Type::F64 ? Type::F64 : Type::I64;
+    a = convert(a, type);
+    b = convert(b, type);
+
+    return emit({.op = op, .type = type, .args = {a, b}});
+}
+
+ir::Value IRGen::genLogic(const BinOpExpr& binop) {
+    if (const auto cond = condOf(binop.opToken.type)) {
+        auto [a, b] = genOperands(binop.lhs, binop.rhs);
+
+        const Type type = typeOf(a) == Type::F64 || typeOf(b) == Type::F64 ? Type::F64 : Type::I64;
+        a = convert(a, type);
+        b = convert(b, type);
+
+        return emit({.op = Opcode::CMP, .type = Type::I64, .args = {a, b}, .cond = *cond});
+    }
+
+    if (binop.opToken.type == TokenType::NOT) {
+        const ir::Value value = genOperand(binop.lhs);
+        return emit({.op = Opcode::CMP, .type = Type::I64, .args = {value, zero(typeOf(value))}, .cond = ir::Cond::EQ});
+    }
+
+    // and/or evaluate their right side only when it decides the result
+    const ir::BlockId trueBlock = createBlock();
+    const ir::BlockId falseBlock = createBlock();
+    const ir::BlockId done = createBlock();
+    genBranch(binop, trueBlock, falseBlock);
+
+    std::vector<std::pair<ir::BlockId, ir::Value> > incoming;
+
+    setBlock(trueBlock);
+    incoming.emplace_back(current, constant(1));
+    jump(done);
+
+    setBlock(falseBlock);
+    incoming.emplace_back(current, constant(0));
+    jump(done);
+
+    setBlock(done);
+    return merge(incoming);
+}
+
+ir::Value IRGen::genDotimes(const DotimesExpr& dotimes) {
+    const auto iterVar = cast::toVar(dotimes.iterationCount);
+    // The count is evaluated once, before the first iteration
+    const ir::Value count = genOperand(iterVar->value);
+
+    const int32_t slot = bind(iterVar->name, Type::I64);
+    emit({.op = Opcode::STORE, .args = {constant(0)}, .slot = slot});
+
+    const ir::BlockId header = createBlock();
+    const ir::BlockId body = createBlock();
+    const ir::BlockId done = createBlock();
+
+    jump(header);
+    setBlock(header);
+    const ir::Value index = emit({.op = Opcode::LOAD, .type = Type::I64, .slot = slot});
+    const ir::Value test = emit({
+        .op = Opcode::CMP, .type = Type::I64, .args = {index, count}, .cond = ir::Cond::LT
+    });
+    emit({.op = Opcode::CBR, .args = {test}, .targets = {body, done}});
+
+    setBlock(body);
+    loopExits.push_back(done);
+    genBody(dotimes.statements);
+    loopExits.pop_back();
+
+    const ir::Value last = emit({.op = Opcode::LOAD, .type = Type::I64, .slot = slot});
+    const ir::Value next = emit({.op = Opcode::ADD, .type = Type::I64, .args = {last, constant(1)}});
+    emit({.op = Opcode::STORE, .args = {next}, .slot = slot});
+    jump(header);
+
+    setBlock(done);
+    locals[iterVar->name].pop_back();
+
+    return ir::NONE;
+}
+
+ir::Value IRGen::genLoop(const LoopExpr& loop) {
+    const ir::BlockId header = createBlock();
+    const ir::BlockId done = createBlock();
+
+    jump(header);
+    setBlock(header);
+
+    loopExits.push_back(done);
+    genBody(loop.sexprs);
+    loopExits.pop_back();
+
+    jump(header);
+    setBlock(done);
+
+    return ir::NONE;
+}
+
+ir::Value IRGen::genLet(const LetExpr& let) {
+    for (const auto& binding: let.bindings) {
+        const auto var = cast::toVar(binding);
+        // Bound after its value is computed, so the value still sees outer bindings
+        const ir::Value value = genExpr(var->value);
+        const Type type = value ? typeOf(value) : typeOfVar(var->vType);
+
+        emit({.op = Opcode::STORE, .args = {value ? value : zero(type)}, .slot = bind(var->name, type)});
+    }
+
+    const ir::Value result = genBody(let.body);
+
+    for (const auto& binding: let.bindings) {
+        locals[cast::toVar(binding)->name].pop_back();
+    }
+
+    return result;
+}
+
+ir::Value IRGen::genSetq(const SetqExpr& setq) {
+    const auto var = cast::toVar(setq.pair);
+    const ir::Value value = genOperand(var->value);
+
+    genStore(*var, value);
+    return value;
+}
+
+ir::Value IRGen::genFuncCall(const FuncCallExpr& funcCall) {
+    const DefunExpr* callee = funcCall.callee ? cast::toDefun(funcCall.callee) : nullptr;
+    if (!callee) {
+        const auto it = functions.find(cast::toVar(funcCall.name)->name);
+        callee = it != functions.end() ? it->second : nullptr;
+    }
+
+    ir::Instr call{
+        .op = Opcode::CALL,
+        .type = returnTypeOf(callee),
+        .symbol = cast::toVar(callee ? callee->name : funcCall.name)->name
+    };
+
+    for (size_t i = 0; i < funcCall.args.size(); ++i) {
+        const auto arg = cast::toVar(funcCall.args[i]);
+        const auto param = callee ? cast::toVar(callee->args[i]) : arg;
+
+        call.args.push_back(convert(genOperand(arg->value), typeOfVar(param->vType)));
+    }
+
+    return emit(std::move(call));
+}
+
+void IRGen::genReturn() {
+    if (!loopExits.empty())
+        jump(loopExits.back());
+}
+
+ir::Value IRGen::genIf(const IfExpr& if_) {
+    const ir::BlockId thenBlock = createBlock();
+    const ir::BlockId elseBlock = createBlock();
+    const ir::BlockId done = createBlock();
+    genBranch(if_.test, thenBlock, elseBlock);
+
+    std::vector<std::pair<ir::BlockId, ir::Value> > incoming;
+
+    setBlock(thenBlock);
+    const ir::Value then = genExpr(if_.then);
+    if (!isTerminated()) {
+        incoming.emplace_back(current, then);
+        jump(done);
+    }
+
+    setBlock(elseBlock);
+    const ir::Value else_ = genExpr(if_.else_);
+    if (!isTerminated()) {
+        incoming.emplace_back(current, else_);
+        jump(done);
+    }
+
+    setBlock(done);
+    return merge(incoming);
+}
+
+ir::Value IRGen::genWhen(const WhenExpr& when) {
+    const ir::BlockId thenBlock = createBlock();
+    const ir::BlockId elseBlock = createBlock();
+    const ir::BlockId done = createBlock();
+    genBranch(when.test, thenBlock, elseBlock);
+
+    std::vector<std::pair<ir::BlockId, ir::Value> > incoming;
+
+    setBlock(thenBlock);
+    const ir::Value then = genBody(when.then);
+    if (!isTerminated()) {
+        incoming.emplace_back(current, then);
+        jump(done);
+    }
+
+    setBlock(elseBlock);
+    incoming.emplace_back(current, ir::NONE);
+    jump(done);
+
+    setBlock(done);
+    return merge(incoming);
+}
+
+ir::Value IRGen::genCond(const CondExpr& cond) {
+    const ir::BlockId done = createBlock();
+    std::vector<std::pair<ir::BlockId, ir::Value> > incoming;
+
+    for (const auto& [test, forms]: cond.variants) {
+        const ir::BlockId thenBlock = createBlock();
+        const ir::BlockId next = createBlock();
+        genBranch(test, thenBlock, next);
+
+        setBlock(thenBlock);
+        const ir::Value then = genBody(forms);
+        if (!isTerminated()) {
+            incoming.emplace_back(current, then);
+            jump(done);
+        }
+
+        setBlock(next);
+    }
+
+    // No test held
+    if (!isTerminated()) {
+        incoming.emplace_back(current, ir::NONE);
+        jump(done);
+    }
+
+    setBlock(done);
+    return merge(incoming);
+}
+
+void IRGen::genBranch(const ExprPtr test, const ir::BlockId trueBlock, const ir::BlockId falseBlock) {
+    recursion::guard([&] {
+        if (cast::toT(test)) {
+            jump(trueBlock);
+            return;
+        }
+
+        if (cast::toNIL(test)) {
+            jump(falseBlock);
+            return;
+        }
+
+        if (const auto binop = cast::toBinop(test); binop && genBranch(*binop, trueBlock, falseBlock))
+            return;
+
+        const ir::Value value = genOperand(test);
+        const ir::Value nonZero = emit({
+            .op = Opcode::CMP, .type = Type::I64, .args = {value, zero(typeOf(value))}, .cond = ir::Cond::NE
+        });
+        emit({.op = Opcode::CBR, .args = {nonZero}, .targets = {trueBlock, falseBlock}});
+    });
+}
+
+bool IRGen::genBranch(const BinOpExpr& binop, const ir::BlockId trueBlock, const ir::BlockId falseBlock) {
+    switch (binop.opToken.type) {
+        case TokenType::AND: {
+            const ir::BlockId next = createBlock();
+            genBranch(binop.lhs, next, falseBlock);
+            setBlock(next);
+            genBranch(binop.rhs, trueBlock, falseBlock);
+            return true;
+        }
+        case TokenType::OR: {
+            const ir::BlockId next = createBlock();
+            genBranch(binop.lhs, trueBlock, next);
+            setBlock(next);
+            genBranch(binop.rhs, trueBlock, falseBlock);
+            return true;
+        }
+        case TokenType::NOT:
+            genBranch(binop.lhs, falseBlock, trueBlock);
+            return true;
+        default:
+            break;
+    }
+
+    if (!condOf(binop.opToken.type))
+        return false;
+
+    const ir::Value value = genLogic(binop);
+    emit({.op = Opcode::CBR, .args = {value}, .targets = {trueBlock, falseBlock}});
+    return true;
+}
+
+ir::Value IRGen::genLoad(const VarExpr& var) {
+    if (var.sType != SymbolType::GLOBAL) {
+        if (const auto it = locals.find(var.name); it != locals.end() && !it->second.empty()) {
+            const int32_t slot = it->second.back();
+            return emit({.op = Opcode::LOAD, .type = fn->slots[slot], .slot = slot});
+        }
+    }
+
+    const auto it = globals.find(var.name);
+    if (it == globals.end())
+        return emit({.op = Opcode::LOAD, .type = typeOfVar(var.vType), .symbol = var.name});
+
+    const auto& global = module.globals[it->second];
+    if (global.isString)
+        return emit({.op = Opcode::ADDR, .type = Type::I64, .symbol = var.name});
+
+    return emit({.op = Opcode::LOAD, .type = global.type, .symbol = var.name});
+}
+
+void IRGen::genStore(const VarExpr& var, const ir::Value value) {
+    if (var.sType != SymbolType::GLOBAL) {
+        if (const auto it = locals.find(var.name); it != locals.end() && !it->second.empty()) {
+            const int32_t slot = it->second.back();
+            emit({.op = Opcode::STORE, .args = {convert(value, fn->slots[slot])}, .slot = slot});
+            return;
+        }
+    }
+
+    const auto it = globals.find(var.name);
+    const Type type = it != globals.end() ? module.globals[it->second].type : typeOf(value);
+    emit({.op = Opcode::STORE, .args = {convert(value, type)}, .symbol = var.name});
+}
+
+ir::Value IRGen::genString(const std::string& str) {
+    const SymbolId name = symbol::intern("str." + std::to_string(stringCount++));
+
+    module.globals.push_back({
+        .name = name, .section = ir::Global::Section::RODATA, .isString = true, .str = str
+    });
+
+    return emit({.op = Opcode::ADDR, .type = Type::I64, .symbol = name});
+}
+
+ir::Value IRGen::merge(std::vector<std::pair<ir::BlockId, ir::Value> > incoming) {
+    if (incoming.empty())
+        return ir::NONE;
+
+    if (incoming.size() == 1)
+        return incoming.front().second;
+
+    Type type = Type::VOID;
+    for (const auto& [block, value]: incoming) {
+        if (value && (type == Type::VOID || typeOf(value) == Type::F64))
+            type = typeOf(value);
+    }
+
+    // Nothing to merge when no branch has a value
+    if (type == Type::VOID)
+        return ir::NONE;
+
+    const ir::BlockId done = current;
+    ir::Instr phi{.op = Opcode::PHI, .type = type};
+
+    for (auto& [block, value]: incoming) {
+        // Conversions go at the end of the predecessor, before its jump
+        auto& instrs = fn->blocks[block].instrs;
+        ir::Instr terminator = std::move(instrs.back());
+        instrs.pop_back();
+
+        current = block;
+        phi.args.push_back(convert(value ? value : zero(type), type));
+        phi.targets.push_back(block);
+
+        fn->blocks[block].instrs.push_back(std::move(terminator));
+    }
+
+    current = done;
+    return emit(std::move(phi));
+}
+
+ir::Value IRGen::convert(const ir::Value value, const Type type) {
+    if (type == Type::VOID || typeOf(value) == Type::VOID || typeOf(value) == type)
+        return value;
+
+    return emit({.op = Opcode::CVT, .type = type, .args = {value}});
+}
+
+ir::Value IRGen::constant(const int64_t n) {
+    return emit({.op = Opcode::CONST, .type = Type::I64, .imm = n});
+}
+
+ir::Value IRGen::constantDouble(const double n) {
+    return emit({.op = Opcode::CONST, .type = Type::F64, .fimm = n});
+}
+
+ir::Value IRGen::zero(const Type type) {
+    return type == Type::F64 ? constantDouble(0.0) : constant(0);
+}
+
+ir::Value IRGen::emit(ir::Instr instr) {
+    // Code after a jump is unreachable, it still needs a block to go to
+    if (isTerminated())
+        setBlock(createBlock());
+
+    if (instr.type != Type::VOID) {
+        instr.dst = fn->values.size();
+        fn->values.push_back(instr.type);
+    }
+
+    const ir::Value dst = instr.dst;
+    fn->blocks[current].instrs.push_back(std::move(instr));
+
+    return dst;
+}
+
+ir::BlockId IRGen::createBlock() {
+    fn->blocks.emplace_back();
+    return fn->blocks.size() - 1;
+}
+
+void IRGen::setBlock(const ir::BlockId block) {
+    current = block;
+}
+
+void IRGen::jump(const ir::BlockId target) {
+    if (!isTerminated())
+        emit({.op = Opcode::BR, .targets = {target}});
+}
+
+bool IRGen::isTerminated() const {
+    const auto& instrs = fn->blocks[current].instrs;
+    return !instrs.empty() && ir::isTerminator(instrs.back().op);
+}
+
+Type IRGen::typeOf(const ir::Value value) const {
+    return fn->values[value];
+}
+
+int32_t IRGen::bind(const SymbolId name, const Type type) {
+    const auto slot = static_cast<int32_t>(fn->slots.size());
+    fn->slots.push_back(type);
+    locals[name].push_back(slot);
+
+    return slot;
+}
@@ -0,0 +1,111 @@
+#ifndef IRGEN_H
+#define IRGEN_H
+
+#include <unordered_map>
+#include "ir.h"
+#include "parser.h"
+
+// Lowers the checked and folded program into IR. Top-level forms other than definitions
+// become the body of the entry function, every function and specialization becomes an
+// IR function of its own. Locals and parameters are stored in stack slots, which
+// SlotPromoter then turns into SSA values.
+class IRGen {
+public:
+    ir::Module generate(const Program& program);
+
+private:
+    void genGlobal(const VarExpr& var, bool isConstant);
+
+    void genFunction(const DefunExpr& defun);
+
+    ir::Value genExpr(ExprPtr expr);
+
+    ir::Value genBody(const std::vector<ExprPtr>& body);
+
+    // Value of an expression used as an operand, 0 for forms without one
+    ir::Value genOperand(ExprPtr expr);
+
+    ir::Value genBinop(const BinOpExpr& binop);
+
+    // Values of the two sides of a binary operator, in their order
+    std::pair<ir::Value, ir::Value> genOperands(ExprPtr lhs, ExprPtr rhs);
+
+    int registerNeed(const IExpr* expr);
+
+    ir::Value genArith(ir::Opcode op, ExprPtr lhs, ExprPtr rhs);
+
+    ir::Value genLogic(const BinOpExpr& binop);
+
+    ir::Value genDotimes(const DotimesExpr& dotimes);
+
+    ir::Value genLoop(const LoopExpr& loop);
+
+    ir::Value genLet(const LetExpr& let);
+
+    ir::Value genSetq(const SetqExpr& setq);
+
+    ir::Value genFuncCall(const FuncCallExpr& funcCall);
+
+    void genReturn();
+
+    ir::Value genIf(const IfExpr& if_);
+
+    ir::Value genWhen(const WhenExpr& when);
+
+    ir::Value genCond(const CondExpr& cond);
+
+    void genBranch(ExprPtr test, ir::BlockId trueBlock, ir::BlockId falseBlock);
+
+    // Branches on logical operators and comparisons; false for other operators
+    bool genBranch(const BinOpExpr& binop, ir::BlockId trueBlock, ir::BlockId falseBlock);
+
+    // Variables load the binding they name; the analyzer substitutes definitions for
+    // some references, which name the same binding
+    ir::Value genLoad(const VarExpr& var);
+
+    void genStore(const VarExpr& var, ir::Value value);
+
+    ir::Value genString(const std::string& str);
+
+    // Joins the values the branches jumping to the current block end with
+    ir::Value merge(std::vector<std::pair<ir::BlockId, ir::Value> > incoming);
+
+    ir::Value convert(ir::Value value, ir::Type type);
+
+    ir::Value constant(int64_t n);
+
+    ir::Value constantDouble(double n);
+
+    ir::Value zero(ir::Type type);
+
+    ir::Value emit(ir::Instr instr);
+
+    ir::BlockId createBlock();
+
+    void setBlock(ir::BlockId block);
+
+    void jump(ir::BlockId target);
+
+    [[nodiscard]] bool isTerminated() const;
+
+    [[nodiscard]] ir::Type typeOf(ir::Value value) const;
+
+    int32_t bind(SymbolId name, ir::Type type);
+
+    ir::Function* fn{};
+    ir::BlockId current{};
+    ir::Module module;
+    // Stack slots of the locals in scope, innermost binding last
+    std::unordered_map<SymbolId, std::vector<int32_t> > locals;
+    // Exit blocks of the enclosing loops, innermost last
+    std::vector<ir::BlockId> loopExits;
+    // Index of every global in the module
+    std::unordered_map<SymbolId, size_t> globals;
+    // Definitions by name, for calls not resolved to a specialization
+    std::unordered_map<SymbolId, const DefunExpr*> functions;
+    // Registers each binary operator tree needs, labeled as operands are lowered
+    std::unordered_map<const BinOpExpr*, int> registerNeeds;
+    int stringCount{0};
+};
+
+#endif //IRGEN_H
@@ -0,0 +1,440 @@
+#include "isel.h"
+#include <bit>
+#include <utility>
+
+using ir::Opcode;
+using mir::CC;
+using mir::Op;
+using mir::Operand;
+using mir::RegClass;
+
+static CC swapped(const ir::Cond cond) {
+    switch (cond) {
+        case ir::Cond::LT:
+            return CC::G;
+        case ir::Cond::GT:
+            return CC::L;
+        case ir::Cond::LE:
+            return CC::GE;
+        case ir::Cond::GE:
+            return CC::LE;
+        case ir::Cond::NE:
+            return CC::NE;
+        default:
+            return CC::E;
+    }
+}
+
+static CC signedCC(const ir::Cond cond) {
+    switch (cond) {
+        case ir::Cond::LT:
+            return CC::L;
+        case ir::Cond::GT:
+            return CC::G;
+        case ir::Cond::LE:
+            return CC::LE;
+        case ir::Cond::GE:
+            return CC::GE;
+        case ir::Cond::NE:
+            return CC::NE;
+        default:
+            return CC::E;
+    }
+}
+
+mir::Function InstructionSelector::select(const ir::Function& fn_) {
+    fn = &fn_;
+    out = {.name = fn->name, .isEntry = fn->isEntry, .slots = static_cast<uint32_t>(fn->slots.size())};
+    out.blocks.resize(fn->blocks.size());
+
+    operands.assign(fn->values.size(), {});
+    uses.assign(fn->values.size(), 0);
+    phiTemps.assign(fn->values.size(), {});
+
+    for (const auto& block: fn->blocks) {
+        for (const auto& instr: block.instrs) {
+            for (const ir::Value arg: instr.args) {
+                uses[arg]++;
+            }
+
+            if (instr.dst == ir::NONE)
+                continue;
+
+            if (instr.op == Opcode::CONST && instr.type == ir::Type::I64 && mir::fitsImm32(instr.imm)) {
+                operands[instr.dst] = Operand::immediate(instr.imm);
+            } else {
+                operands[instr.dst] = createVreg(classOf(instr.dst));
+            }
+
+            if (instr.op == Opcode::PHI)
+                phiTemps[instr.dst] = createVreg(classOf(instr.dst));
+        }
+    }
+
+    for (ir::BlockId id = 0; id < fn->blocks.size(); ++id) {
+        current = &out.blocks[id];
+        const auto& instrs = fn->blocks[id].instrs;
+
+        for (size_t i = 0; i + 1 < instrs.size(); ++i) {
+            const auto& instr = instrs[i];
+
+            // A comparison only the following branch reads sets the flags for it
+            if (instr.op == Opcode::CMP && i + 2 == instrs.size() && instrs.back().op == Opcode::CBR &&
+                instrs.back().args[0] == instr.dst && uses[instr.dst] == 1) {
+                pendingCompare = &instr;
+                continue;
+            }
+
+            selectInstr(instr);
+        }
+
+        copyToPhis(id);
+        selectTerminator(instrs.back());
+        pendingCompare = nullptr;
+    }
+
+    return std::move(out);
+}
+
+void InstructionSelector::selectInstr(const ir::Instr& instr) {
+    switch (instr.op) {
+        case Opcode::CONST:
+            if (instr.type == ir::Type::F64) {
+                // No immediate form for doubles, the bits go through a general purpose register
+                const Operand bits = createVreg(RegClass::GPR);
+                emit(Op::MOV, bits, Operand::immediate(std::bit_cast<int64_t>(instr.fimm)));
+                emit(Op::MOVQ, def(instr.dst), bits);
+            } else if (!mir::fitsImm32(instr.imm)) {
+                emit(Op::MOV, def(instr.dst), Operand::immediate(instr.imm));
+            }
+            break;
+        case Opcode::ADDR:
+            emit(Op::LEA, def(instr.dst), Operand::global(instr.symbol));
+            break;
+        case Opcode::PARAM:
+            selectParam(instr);
+            break;
+        case Opcode::ADD:
+        case Opcode::SUB:
+        case Opcode::MUL:
+        case Opcode::AND:
+        case Opcode::OR:
+        case Opcode::XOR:
+            selectArith(instr);
+            break;
+        case Opcode::DIV:
+            if (instr.type == ir::Type::F64) {
+                selectArith(instr);
+            } else {
+                selectDiv(instr);
+            }
+            break;
+        case Opcode::CMP: {
+            const CC cc = selectCompare(instr);
+            emit(Op::SETCC, def(instr.dst), {}, cc);
+            emit(Op::MOVZX, def(instr.dst), def(instr.dst));
+            break;
+        }
+        case Opcode::CVT: {
+            Operand src = use(instr.args[0]);
+            if (src.kind == Operand::Kind::IMM)
+                src = reg(instr.args[0]);
+            emit(instr.type == ir::Type::F64 ? Op::CVTSI2SD : Op::CVTTSD2SI, def(instr.dst), src);
+            break;
+        }
+        case Opcode::LOAD: {
+            const Operand src = instr.slot >= 0 ? Operand::slot(instr.slot) : Operand::global(instr.symbol);
+            move(classOf(instr.dst), def(instr.dst), src);
+            break;
+        }
+        case Opcode::STORE: {
+            const Operand dst = instr.slot >= 0 ? Operand::slot(instr.slot) : Operand::global(instr.symbol);
+            const ir::Value value = instr.args[0];
+            move(classOf(value), dst, classOf(value) == RegClass::SSE ? reg(value) : use(value));
+            break;
+        }
+        case Opcode::CALL:
+            selectCall(instr);
+            break;
+        case Opcode::PHI:
+            move(classOf(instr.dst), def(instr.dst), phiTemps[instr.dst]);
+            break;
+        default:
+            break;
+    }
+}
+
+void InstructionSelector::selectArith(const ir::Instr& instr) {
+    const Operand dst = def(instr.dst);
+
+    if (instr.type == ir::Type::F64) {
+        static constexpr Op ops[] = {Op::ADDSD, Op::SUBSD, Op::MULSD, Op::DIVSD};
+
+        emit(Op::MOVSD, dst, reg(instr.args[0]));
+        emit(ops[static_cast<int>(instr.op) - static_cast<int>(Opcode::ADD)], dst, reg(instr.args[1]));
+        return;
+    }
+
+    Op op;
+    switch (instr.op) {
+        case Opcode::ADD:
+            op = Op::ADD;
+            break;
+        case Opcode::SUB:
+            op = Op::SUB;
+            break;
+        case Opcode::MUL:
+            op = Op::IMUL;
+            break;
+        case Opcode::AND:
+            op = Op::AND;
+            break;
+        case Opcode::OR:
+            op = Op::OR;
+            break;
+        default:
+            op = Op::XOR;
+            break;
+    }
+
+    emit(Op::MOV, dst, use(instr.args[0]));
+    emit(op, dst, use(instr.args[1]));
+}
+
+void InstructionSelector::selectDiv(const ir::Instr& instr) {
+    // rax -> dividend
+    // idiv divisor[register/memory]
+    const Operand divisor = reg(instr.args[1]);
+
+    emit(Op::MOV, Operand::preg(RAX), use(instr.args[0]));
+    emit(Op::CQO);
+    emit(Op::IDIV, divisor);
+    emit(Op::MOV, def(instr.dst), Operand::preg(RAX));
+}
+
+void InstructionSelector::selectCall(const ir::Instr& instr) {
+    uint8_t gprArgs = 0, sseArgs = 0;
+    std::vector<ir::Value> stackArgs;
+
+    for (const ir::Value arg: instr.args) {
+        if (classOf(arg) == RegClass::SSE ? sseArgs++ >= std::size(paramRegistersSSE)
+                                          : gprArgs++ >= std::size(paramRegisters)) {
+            stackArgs.push_back(arg);
+        }
+    }
+    gprArgs = std::min<uint8_t>(gprArgs, std::size(paramRegisters));
+    sseArgs = std::min<uint8_t>(sseArgs, std::size(paramRegistersSSE));
+
+    // Keep rsp 16 byte aligned at the call
+    const int64_t padding = stackArgs.size() % 2 ? 8 : 0;
+    if (padding)
+        emit(Op::SUB, Operand::preg(RSP), Operand::immediate(padding));
+
+    for (auto it = stackArgs.rbegin(); it != stackArgs.rend(); ++it) {
+        if (classOf(*it) == RegClass::SSE) {
+            const Operand bits = createVreg(RegClass::GPR);
+            emit(Op::MOVQ, bits, reg(*it));
+            emit(Op::PUSH, bits);
+        } else {
+            emit(Op::PUSH, use(*it));
+        }
+    }
+
+    // The argument registers are filled at once, the register allocator orders the moves
+    std::vector<mir::Instr> moves;
+    int gprIdx = 0, sseIdx = 0;
+    for (const ir::Value arg: instr.args) {
+        if (classOf(arg) == RegClass::SSE) {
+            if (sseIdx < sseArgs) {
+                moves.push_back({
+                    .op = Op::MOVSD, .dst = Operand::preg(paramRegistersSSE[sseIdx++]), .src = reg(arg),
+                    .isParallel = true
+                });
+            }
+        } else if (gprIdx < gprArgs) {
+            moves.push_back({
+                .op = Op::MOV, .dst = Operand::preg(paramRegisters[gprIdx++]), .src = use(arg), .isParallel = true
+            });
+        }
+    }
+    current->instrs.insert(current->instrs.end(), moves.begin(), moves.end());
+
+    current->instrs.push_back({
+        .op = Op::CALL, .dst = Operand::function(instr.symbol), .gprArgs = gprArgs, .sseArgs = sseArgs
+    });
+
+    if (const int64_t size = static_cast<int64_t>(stackArgs.size()) * 8 + padding)
+        emit(Op::ADD, Operand::preg(RSP), Operand::immediate(size));
+
+    if (classOf(instr.dst) == RegClass::SSE) {
+        emit(Op::MOVSD, def(instr.dst), Operand::preg(xmm0));
+    } else {
+        emit(Op::MOV, def(instr.dst), Operand::preg(RAX));
+    }
+}
+
+void InstructionSelector::selectParam(const ir::Instr& instr) {
+    const RegClass regClass = classOf(instr.dst);
+
+    // Index of the parameter among those of its class, and among those passed on the stack
+    uint32_t classIdx = 0, stackIdx = 0;
+    size_t gprCount = 0, sseCount = 0;
+    for (int64_t i = 0; i < instr.imm; ++i) {
+        const bool isSSE = fn->params[i] == ir::Type::F64;
+        const bool onStack = isSSE ? sseCount++ >= std::size(paramRegistersSSE) : gprCount++ >= std::size(paramRegisters);
+
+        stackIdx += onStack;
+        classIdx += isSSE == (regClass == RegClass::SSE);
+    }
+
+    if (regClass == RegClass::SSE && classIdx < std::size(paramRegistersSSE)) {
+        emit(Op::MOVSD, def(instr.dst), Operand::preg(paramRegistersSSE[classIdx]));
+    } else if (regClass == RegClass::GPR && classIdx < std::size(paramRegisters)) {
+        emit(Op::MOV, def(instr.dst), Operand::preg(paramRegisters[classIdx]));
+    } else {
+        move(regClass, def(instr.dst), Operand::arg(stackIdx));
+    }
+}
+
+void InstructionSelector::selectTerminator(const ir::Instr& instr) {
+    switch (instr.op) {
+        case Opcode::BR:
+            emit(Op::JMP, Operand::block(instr.targets[0]));
+            break;
+        case Opcode::CBR: {
+            CC cc = CC::NE;
+
+            if (pendingCompare) {
+                cc = selectCompare(*pendingCompare);
+            } else if (const Operand test = use(instr.args[0]); test.kind == Operand::Kind::IMM) {
+                emit(Op::JMP, Operand::block(instr.targets[test.imm ? 0 : 1]));
+                break;
+            } else {
+                emit(Op::CMP, test, Operand::immediate(0));
+            }
+
+            emit(Op::JCC, Operand::block(instr.targets[0]), {}, cc);
+            emit(Op::JMP, Operand::block(instr.targets[1]));
+            break;
+        }
+        case Opcode::RET:
+            if (fn->isEntry) {
+                emit(Op::EXIT);
+                break;
+            }
+
+            if (instr.args.empty()) {
+                emit(Op::RET);
+            } else if (const ir::Value value = instr.args[0]; classOf(value) == RegClass::SSE) {
+                emit(Op::MOVSD, Operand::preg(xmm0), reg(value));
+                current->instrs.push_back({.op = Op::RET, .sseArgs = 1});
+            } else {
+                emit(Op::MOV, Operand::preg(RAX), use(value));
+                current->instrs.push_back({.op = Op::RET, .gprArgs = 1});
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+CC InstructionSelector::selectCompare(const ir::Instr& compare) {
+    ir::Value lhs = compare.args[0];
+    ir::Value rhs = compare.args[1];
+
+    if (classOf(lhs) == RegClass::SSE) {
+        // ucomisd sets the flags like an unsigned compare; a < b is tested as b > a so that
+        // unordered operands compare false
+        CC cc;
+        switch (compare.cond) {
+            case ir::Cond::LT:
+                std::swap(lhs, rhs);
+                cc = CC::A;
+                break;
+            case ir::Cond::LE:
+                std::swap(lhs, rhs);
+                cc = CC::AE;
+                break;
+            case ir::Cond::GT:
+                cc = CC::A;
+                break;
+            case ir::Cond::GE:
+                cc = CC::AE;
+                break;
+            case ir::Cond::NE:
+                cc = CC::NE;
+                break;
+            default:
+                cc = CC::E;
+                break;
+        }
+
+        emit(Op::UCOMISD, reg(lhs), reg(rhs));
+        return cc;
+    }
+
+    Operand a = use(lhs);
+    const Operand b = use(rhs);
+
+    if (a.kind == Operand::Kind::IMM && b.kind != Operand::Kind::IMM) {
+        emit(Op::CMP, b, a);
+        return swapped(compare.cond);
+    }
+
+    if (a.kind == Operand::Kind::IMM)
+        a = reg(lhs);
+
+    emit(Op::CMP, a, b);
+    return signedCC(compare.cond);
+}
+
+void InstructionSelector::copyToPhis(const ir::BlockId block) {
+    for (const ir::BlockId succ: ir::successors(fn->blocks[block])) {
+        for (const auto& instr: fn->blocks[succ].instrs) {
+            if (instr.op != Opcode::PHI)
+                break;
+
+            for (size_t i = 0; i < instr.targets.size(); ++i) {
+                if (instr.targets[i] != block) continue;
+
+                const ir::Value value = instr.args[i];
+                move(classOf(instr.dst), phiTemps[instr.dst], classOf(value) == RegClass::SSE ? reg(value) : use(value));
+            }
+        }
+    }
+}
+
+Operand InstructionSelector::use(const ir::Value value) {
+    return operands[value];
+}
+
+Operand InstructionSelector::reg(const ir::Value value) {
+    const Operand operand = operands[value];
+    if (operand.kind != Operand::Kind::IMM)
+        return operand;
+
+    const Operand tmp = createVreg(RegClass::GPR);
+    emit(Op::MOV, tmp, operand);
+    return tmp;
+}
+
+Operand InstructionSelector::def(const ir::Value value) const {
+    return operands[value];
+}
+
+Operand InstructionSelector::createVreg(const RegClass regClass) {
+    out.vregs.push_back(regClass);
+    return Operand::vreg(out.vregs.size() - 1);
+}
+
+void InstructionSelector::emit(const Op op, const Operand dst, const Operand src, const CC cc) {
+    current->instrs.push_back({.op = op, .cc = cc, .dst = dst, .src = src});
+}
+
+void InstructionSelector::move(const RegClass regClass, const Operand dst, const Operand src) {
+    emit(regClass == RegClass::SSE ? Op::MOVSD : Op::MOV, dst, src);
+}
+
+RegClass InstructionSelector::classOf(const ir::Value value) const {
+    return fn->values[value] == ir::Type::F64 ? RegClass::SSE : RegClass::GPR;
+}
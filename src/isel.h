@@ -0,0 +1,63 @@
+#ifndef ISEL_H
+#define ISEL_H
+
+#include "ir.h"
+#include "mir.h"
+
+// Turns an IR function into x86-64 instructions over virtual registers. Every IR value
+// gets a virtual register of its own, except integer constants that fit the immediate
+// field of the instructions using them. Comparisons feeding the branch right after them
+// become a compare and a conditional jump. Phi nodes are removed by copying into a
+// temporary at the end of every predecessor and out of it where the phi was.
+class InstructionSelector {
+public:
+    mir::Function select(const ir::Function& fn);
+
+private:
+    void selectInstr(const ir::Instr& instr);
+
+    void selectArith(const ir::Instr& instr);
+
+    void selectDiv(const ir::Instr& instr);
+
+    void selectCall(const ir::Instr& instr);
+
+    void selectParam(const ir::Instr& instr);
+
+    void selectTerminator(const ir::Instr& instr);
+
+    // Sets the flags for a comparison and returns the condition code that holds when it is true
+    mir::CC selectCompare(const ir::Instr& compare);
+
+    void copyToPhis(ir::BlockId block);
+
+    // Operand of a value, an immediate for small integer constants
+    mir::Operand use(ir::Value value);
+
+    // Register holding a value, constants are moved into a new one
+    mir::Operand reg(ir::Value value);
+
+    mir::Operand def(ir::Value value) const;
+
+    mir::Operand createVreg(mir::RegClass regClass);
+
+    void emit(mir::Op op, mir::Operand dst = {}, mir::Operand src = {}, mir::CC cc = {});
+
+    void move(mir::RegClass regClass, mir::Operand dst, mir::Operand src);
+
+    [[nodiscard]] mir::RegClass classOf(ir::Value value) const;
+
+    const ir::Function* fn{};
+    mir::Function out;
+    mir::Block* current{};
+    // Operand every value was selected to
+    std::vector<mir::Operand> operands;
+    // Number of uses of every value
+    std::vector<uint32_t> uses;
+    // Temporary every phi is copied through
+    std::vector<mir::Operand> phiTemps;
+    // Comparison left for the branch that ends the block
+    const ir::Instr* pendingCompare{};
+};
+
+#endif //ISEL_H
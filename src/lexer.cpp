@@ -1,164 +1,293 @@
 #include "lexer.h"
-#include <cstring>
+#include <bit>
+#include <cassert>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include "exceptions.hpp"
 
-Lexer::Lexer(const char* fn, std::string text) : text(std::move(text)), pos(-1, 0, -1), fileName(fn) {
-    advance();
+struct Keyword {
+    std::string_view name;
+    TokenType type;
+};
+
+static constexpr Keyword keywords[] = {
+    {"dotimes", TokenType::DOTIMES},
+    {"return", TokenType::RETURN},
+    {"loop", TokenType::LOOP},
+    {"let", TokenType::LET},
+    {"setq", TokenType::SETQ},
+    {"if", TokenType::IF},
+    {"when", TokenType::WHEN},
+    {"cond", TokenType::COND},
+    {"defvar", TokenType::DEFVAR},
+    {"defconstant", TokenType::DEFCONST},
+    {"defun", TokenType::DEFUN},
+    {"nil", TokenType::NIL},
+    {"t", TokenType::T},
+    {"logand", TokenType::LOGAND},
+    {"logior", TokenType::LOGIOR},
+    {"logxor", TokenType::LOGXOR},
+    {"lognor", TokenType::LOGNOR},
+    {"and", TokenType::AND},
+    {"or", TokenType::OR},
+    {"not", TokenType::NOT},
+};
+
+static constexpr size_t KEYWORD_TABLE_SIZE = 32;
+
+// The first and the middle character are enough to tell every keyword apart
+static constexpr size_t keywordHash(const std::string_view word) {
+    return (6 * static_cast<unsigned char>(word[0]) +
+            7 * static_cast<unsigned char>(word[word.size() / 2])) % KEYWORD_TABLE_SIZE;
 }
 
-void Lexer::process() {
-    while (currentChar) {
-        if (currentChar[0] == '\t' || currentChar[0] == '\n' || std::isspace(currentChar[0])) {
-            advance();
-        } else if (!std::strncmp("dotimes", currentChar, 7)) {
-            tokens.emplace_back(TokenType::DOTIMES);
-            advance(7);
-        } else if (!std::strncmp("return", currentChar, 6)) {
-            tokens.emplace_back(TokenType::RETURN);
-            advance(6);
-        } else if (!std::strncmp("loop", currentChar, 4)) {
-            tokens.emplace_back(TokenType::LOOP);
-            advance(4);
-        } else if (!std::strncmp("let", currentChar, 3)) {
-            tokens.emplace_back(TokenType::LET);
-            advance(3);
-        } else if (!std::strncmp("setq", currentChar, 4)) {
-            tokens.emplace_back(TokenType::SETQ);
-            advance(4);
-        } else if (!std::strncmp("if", currentChar, 2)) {
-            tokens.emplace_back(TokenType::IF);
-            advance(2);
-        } else if (!std::strncmp("when", currentChar, 4)) {
-            tokens.emplace_back(TokenType::WHEN);
-            advance(4);
-        } else if (!std::strncmp("cond", currentChar, 4)) {
-            tokens.emplace_back(TokenType::COND);
-            advance(4);
-        } else if (!std::strncmp("defvar", currentChar, 4)) {
-            tokens.emplace_back(TokenType::DEFVAR);
-            advance(6);
-        } else if (!std::strncmp("defconstant", currentChar, 11)) {
-            tokens.emplace_back(TokenType::DEFCONST);
-            advance(11);
-        } else if (!std::strncmp("defun", currentChar, 5)) {
-            tokens.emplace_back(TokenType::DEFUN);
-            advance(5);
-        } else if (!std::strncmp("nil", currentChar, 3)) {
-            tokens.emplace_back(TokenType::NIL);
-            advance(3);
-        } else if (!std::strncmp("logand", currentChar, 6)) {
-            tokens.emplace_back(TokenType::LOGAND);
-            advance(6);
-        } else if (!std::strncmp("logior", currentChar, 6)) {
-            tokens.emplace_back(TokenType::LOGIOR);
-            advance(6);
-        } else if (!std::strncmp("logxor", currentChar, 6)) {
-            tokens.emplace_back(TokenType::LOGXOR);
-            advance(6);
-        } else if (!std::strncmp("lognor", currentChar, 6)) {
-            tokens.emplace_back(TokenType::LOGNOR);
-            advance(6);
-        } else if (!std::strncmp("and", currentChar, 3)) {
-            tokens.emplace_back(TokenType::AND);
-            advance(3);
-        } else if (!std::strncmp("or", currentChar, 2)) {
-            tokens.emplace_back(TokenType::OR);
-            advance(2);
-        } else if (!std::strncmp("not", currentChar, 3)) {
-            tokens.emplace_back(TokenType::NOT);
-            advance(3);
-        } else if ((currentChar[0] == 't' && currentChar[1] == ' ') ||
-                   (currentChar[0] == 't' && currentChar[1] == ')')) {
-            tokens.emplace_back(TokenType::T);
-            advance();
-        } else if (std::isalpha(currentChar[0])) {
-            std::string token;
+static constexpr auto keywordTable = [] {
+    std::array<Keyword, KEYWORD_TABLE_SIZE> table{};
 
-            while (currentChar && (std::isalnum(currentChar[0]) || currentChar[0] == '_'  || currentChar[0] == '-')) {
-                token += currentChar[0];
-                advance();
-            }
+    for (const auto& keyword: keywords) {
+        table[keywordHash(keyword.name)] = keyword;
+    }
+
+    return table;
+}();
+
+static_assert([] {
+    for (const auto& keyword: keywords) {
+        if (keywordTable[keywordHash(keyword.name)].name != keyword.name)
+            return false;
+    }
+    return true;
+}(), "Keyword hash is not perfect");
+
+static TokenType keywordType(const std::string_view word) {
+    if (const Keyword& keyword = keywordTable[keywordHash(word)]; keyword.name == word)
+        return keyword.type;
+
+    return TokenType::VAR;
+}
+
+static constexpr bool isAlpha(const char c) { return (c | 0x20) >= 'a' && (c | 0x20) <= 'z'; }
+
+static constexpr bool isDigit(const char c) { return c >= '0' && c <= '9'; }
+
+#if defined(__SSE2__)
+static __m128i inRange(const __m128i chunk, const char lo, const char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8(static_cast<char>(lo - 1))),
+                         _mm_cmplt_epi8(chunk, _mm_set1_epi8(static_cast<char>(hi + 1))));
+}
+
+static __m128i equal(const __m128i chunk, const char c) {
+    return _mm_cmpeq_epi8(chunk, _mm_set1_epi8(c));
+}
+
+static __m128i isAlnum(const __m128i chunk) {
+    return _mm_or_si128(inRange(_mm_or_si128(chunk, _mm_set1_epi8(0x20)), 'a', 'z'), inRange(chunk, '0', '9'));
+}
+#endif
+
+/* Character classes. The SSE2 test classifies 16 bytes at once and must agree with the scalar one. */
+
+struct Space {
+    static constexpr bool test(const char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+#if defined(__SSE2__)
+    static __m128i test(const __m128i chunk) { return _mm_or_si128(equal(chunk, ' '), inRange(chunk, '\t', '\r')); }
+#endif
+};
+
+struct Identifier {
+    static constexpr bool test(const char c) { return isAlpha(c) || isDigit(c) || c == '_' || c == '-'; }
+#if defined(__SSE2__)
+    static __m128i test(const __m128i chunk) {
+        return _mm_or_si128(isAlnum(chunk), _mm_or_si128(equal(chunk, '_'), equal(chunk, '-')));
+    }
+#endif
+};
 
-            tokens.emplace_back(TokenType::VAR, token);
-        } else if (std::isdigit(currentChar[0])) {
-            std::string token;
-            bool isDouble{false};
+struct Number {
+    static constexpr bool test(const char c) { return isAlpha(c) || isDigit(c) || c == '.'; }
+#if defined(__SSE2__)
+    static __m128i test(const __m128i chunk) { return _mm_or_si128(isAlnum(chunk), equal(chunk, '.')); }
+#endif
+};
 
-            while (currentChar && (std::isalnum(currentChar[0]) || currentChar[0] == '.')) {
-                if (std::isalpha(currentChar[0]))
-                    throw IllegalCharError(fileName, (token + currentChar[0]).c_str(), pos.lineNumber);
+struct StringBody {
+    static constexpr bool test(const char c) { return c != '"'; }
+#if defined(__SSE2__)
+    static __m128i test(const __m128i chunk) { return _mm_xor_si128(equal(chunk, '"'), _mm_set1_epi8(-1)); }
+#endif
+};
 
-                if (!isDouble && currentChar[0] == '.') isDouble = true;
+// Returns the index of the first byte at or after i that is not in the class
+template<typename Class>
+static size_t span(const std::string_view text, size_t i) {
+    const size_t size = text.size();
+#if defined(__SSE2__)
+    for (; i + 16 <= size; i += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + i));
 
-                token += currentChar[0];
-                advance();
+        if (const unsigned mask = ~_mm_movemask_epi8(Class::test(chunk)) & 0xFFFF)
+            return i + std::countr_zero(mask);
+    }
+#endif
+    while (i < size && Class::test(text[i])) ++i;
+
+    return i;
+}
+
+// Counts the newlines in [from, to) and records the index of the last one
+static int countNewlines(const std::string_view text, size_t from, const size_t to, int& lastNewline) {
+    int newlines = 0;
+#if defined(__SSE2__)
+    for (; from + 16 <= to; from += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + from));
+
+        if (const unsigned mask = _mm_movemask_epi8(equal(chunk, '\n'))) {
+            newlines += std::popcount(mask);
+            lastNewline = static_cast<int>(from) + 31 - std::countl_zero(mask);
+        }
+    }
+#endif
+    for (; from < to; ++from) {
+        if (text[from] == '\n') {
+            ++newlines;
+            lastNewline = static_cast<int>(from);
+        }
+    }
+
+    return newlines;
+}
+
+Lexer::Lexer(const char* fn, const std::string_view text) : text(text), pos(0, 0, 0), fileName(fn) {
+    currentChar = text.empty() ? nullptr : text.data();
+}
+
+const Token* Lexer::next() {
+    const Token* token = peek(0);
+
+    head = (head + 1) % LOOKAHEAD;
+    --count;
+
+    return token;
+}
+
+const Token* Lexer::peek(const size_t offset) {
+    assert(offset < LOOKAHEAD);
+
+    while (count <= offset) {
+        ring[(head + count) % LOOKAHEAD] = scan();
+        ++count;
+    }
+
+    return &ring[(head + offset) % LOOKAHEAD];
+}
+
+Token Lexer::scan() {
+    if (currentChar && Space::test(currentChar[0])) {
+        seek(span<Space>(text, pos.index));
+    }
+
+    const int start = pos.index;
+    const int line = pos.lineNumber;
+    Token token = scanToken();
+    token.offset = start;
+    token.line = line;
+
+    return token;
+}
+
+Token Lexer::scanToken() {
+    if (currentChar) {
+        if (isAlpha(currentChar[0])) {
+            const int start = pos.index;
+
+            seek(span<Identifier>(text, start));
+
+            const std::string_view word{text.data() + start, static_cast<size_t>(pos.index - start)};
+
+            if (const TokenType type = keywordType(word); type != TokenType::VAR)
+                return Token(type);
+
+            return Token(TokenType::VAR, word, symbol::intern(word));
+        } else if (isDigit(currentChar[0])) {
+            const int start = pos.index;
+            const std::string_view number{text.data() + start, span<Number>(text, start) - start};
+
+            for (size_t i = 0; i < number.size(); ++i) {
+                if (isAlpha(number[i]))
+                    throw IllegalCharError(fileName, std::string(number.substr(0, i + 1)).c_str(), pos.lineNumber);
             }
 
-            tokens.emplace_back(isDouble ? TokenType::DOUBLE : TokenType::INT, token);
-        } else if (currentChar[0] == '"') {
-            std::string data;
+            seek(start + number.size());
 
+            return Token(number.find('.') != std::string_view::npos ? TokenType::DOUBLE : TokenType::INT, number);
+        } else if (currentChar[0] == '"') {
             advance();
-            while (currentChar && currentChar[0] != '"') {
-                data += currentChar[0];
-                advance();
-            }
+
+            const int start = pos.index;
+            seek(span<StringBody>(text, start));
+
+            const std::string_view data{text.data() + start, static_cast<size_t>(pos.index - start)};
             advance();
-            tokens.emplace_back(TokenType::STRING, data);
-        } else if (!std::strncmp("/=", currentChar, 2)) {
-            tokens.emplace_back(TokenType::NEQUAL);
+            return Token(TokenType::STRING, data);
+        } else if (text.substr(pos.index).starts_with("/=")) {
             advance(2);
-        } else if (!std::strncmp(">=", currentChar, 2)) {
-            tokens.emplace_back(TokenType::GREATER_THEN_EQ);
+            return Token(TokenType::NEQUAL);
+        } else if (text.substr(pos.index).starts_with(">=")) {
             advance(2);
-        } else if (!std::strncmp("<=", currentChar, 2)) {
-            tokens.emplace_back(TokenType::LESS_THEN_EQ);
+            return Token(TokenType::GREATER_THEN_EQ);
+        } else if (text.substr(pos.index).starts_with("<=")) {
             advance(2);
+            return Token(TokenType::LESS_THEN_EQ);
         } else if (currentChar[0] == '+') {
-            tokens.emplace_back(TokenType::PLUS);
             advance();
+            return Token(TokenType::PLUS);
         } else if (currentChar[0] == '-') {
-            tokens.emplace_back(TokenType::MINUS);
             advance();
+            return Token(TokenType::MINUS);
         } else if (currentChar[0] == '*') {
-            tokens.emplace_back(TokenType::MUL);
             advance();
+            return Token(TokenType::MUL);
         } else if (currentChar[0] == '/') {
-            tokens.emplace_back(TokenType::DIV);
             advance();
+            return Token(TokenType::DIV);
         } else if (currentChar[0] == '=') {
-            tokens.emplace_back(TokenType::EQUAL);
             advance();
+            return Token(TokenType::EQUAL);
         } else if (currentChar[0] == '>') {
-            tokens.emplace_back(TokenType::GREATER_THEN);
             advance();
+            return Token(TokenType::GREATER_THEN);
         } else if (currentChar[0] == '<') {
-            tokens.emplace_back(TokenType::LESS_THEN);
             advance();
+            return Token(TokenType::LESS_THEN);
         } else if (currentChar[0] == '(') {
-            tokens.emplace_back(TokenType::LPAREN);
             advance();
+            return Token(TokenType::LPAREN);
         } else if (currentChar[0] == ')') {
-            tokens.emplace_back(TokenType::RPAREN);
             advance();
+            return Token(TokenType::RPAREN);
         } else {
             throw IllegalCharError(fileName, std::string(1, currentChar[0]).c_str(), pos.lineNumber);
         }
     }
 
-    tokens.emplace_back(TokenType::EOF_);
+    return Token(TokenType::EOF_);
 }
 
 void Lexer::advance() {
-    pos.advance(currentChar);
-
-    if (pos.index < text.size()) {
-        currentChar = &text[pos.index];
-    } else {
-        currentChar = nullptr;
-    }
+    advance(1);
 }
 
 void Lexer::advance(const int step) {
-    for (int i = 0; i < step; ++i) advance();
+    seek(pos.index + step);
+}
+
+void Lexer::seek(size_t index) {
+    index = std::min(index, text.size());
+
+    int lastNewline = -1;
+    const int newlines = countNewlines(text, pos.index, index, lastNewline);
+    pos.advance(static_cast<int>(index) - pos.index, newlines, lastNewline);
+
+    currentChar = index < text.size() ? text.data() + index : nullptr;
 }
@@ -1,8 +1,10 @@
 #ifndef LEXER_H
 #define LEXER_H
 
+#include <array>
 #include <string>
-#include <vector>
+#include <string_view>
+#include "symbol.h"
 
 enum class TokenType {
     // Type
@@ -30,13 +32,22 @@ enum class TokenType {
     EOF_
 };
 
+// Lexemes are views into the source text, which must outlive the tokens
 struct Token {
     TokenType type{};
-    std::string lexeme;
+    std::string_view lexeme;
+    // Byte offset of the token in the source text
+    int offset{};
+    int line{};
+    // Interned name of VAR tokens
+    SymbolId symbol{};
 
     Token() = default;
 
-    explicit Token(const TokenType type, std::string value = "") : type(type), lexeme(std::move(value)) {}
+    explicit Token(const TokenType type, const std::string_view value = {}) : type(type), lexeme(value) {}
+
+    Token(const TokenType type, const std::string_view value, const SymbolId sym) : type(type), lexeme(value),
+        symbol(sym) {}
 };
 
 struct Position {
@@ -46,36 +57,49 @@ struct Position {
 
     Position(const int idx, const int ln, const int coln) : index(idx), lineNumber(ln), columnNumber(coln) {}
 
-    void advance(const char* token) {
-        ++index;
-        ++columnNumber;
+    // Moves forward by count bytes that contain the given number of newlines
+    void advance(const int count, const int newlines, const int lastNewline) {
+        index += count;
 
-        if (token && token[0] == '\n') {
-            ++lineNumber;
-            columnNumber = 0;
+        if (newlines) {
+            lineNumber += newlines;
+            columnNumber = index - lastNewline - 1;
+        } else {
+            columnNumber += count;
         }
     }
 };
 
 class Lexer {
 public:
-    Lexer(const char* fn, std::string text);
-
-    void process();
+    Lexer(const char* fn, std::string_view text);
 
-    [[nodiscard]] size_t getTokenSize() const { return tokens.size(); }
+    // Tokens are produced on demand into a ring of LOOKAHEAD slots. A returned token
+    // stays valid until a later next or peek scans into its slot, which happens once
+    // the tokens read past it fill the ring.
+    const Token* next();
 
-    Token getToken(const int index) { return tokens[index]; }
+    // offset must be below LOOKAHEAD
+    const Token* peek(size_t offset);
 
 private:
+    Token scan();
+
+    Token scanToken();
+
     void advance();
 
     void advance(int step);
 
-    std::string text;
+    void seek(size_t index);
+
+    static constexpr size_t LOOKAHEAD = 4;
+
+    std::string_view text;
     Position pos;
-    std::vector<Token> tokens;
-    char* currentChar{};
+    std::array<Token, LOOKAHEAD> ring;
+    size_t head{0}, count{0};
+    const char* currentChar{};
     const char* fileName;
 };
 
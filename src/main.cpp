@@ -1,8 +1,12 @@
 #include <iostream>
 #include <fstream>
+#include <system_error>
+#include "source.h"
 #include "lexer.h"
 #include "parser.h"
 #include "semantic.h"
+#include "fold.h"
+#include "dce.h"
 #include "codegen.h"
 #include "exceptions.hpp"
 
@@ -17,20 +21,24 @@
 #define ERROR_COLOR "\x1b[31m"
 #define RESET_COLOR "\x1b[0m"
 
-void compile(std::string& fn, const std::string& in, std::string& out) {
+void compile(std::string& fn, const std::string_view in, std::string& out) {
     std::ofstream asmFile;
     asmFile.open(out);
 
     try {
+        Arena arena;
         Lexer lexer{fn.c_str(), in};
-        Parser parser{fn.c_str(), lexer};
-        SemanticAnalyzer analyzer{fn.c_str()};
+        Parser parser{fn.c_str(), lexer, arena};
+        SemanticAnalyzer analyzer{fn.c_str(), arena};
+        ConstantFolder folder{arena};
+        DeadCodeEliminator eliminator;
         CodeGen cgen;
 
-        lexer.process();
-        ExprPtr ast = parser.parse();
-        analyzer.analyze(ast);
-        asmFile << cgen.emit(ast);
+        Program program = parser.parse();
+        analyzer.analyze(program);
+        folder.fold(program);
+        eliminator.eliminate(program);
+        asmFile << cgen.emit(program);
     } catch (IllegalCharError& e) {
         std::cerr << ERROR_COLOR << e.what();
     } catch (InvalidSyntaxError& e) {
@@ -46,6 +54,7 @@ int main(int argc, char** argv) {
     static const char* usage =
             "OVERVIEW: Lisp compiler for x86-64 architecture\n\n"
             "USAGE: tinysexp [options] file\n\n"
+            "  Use - as the file to read from standard input\n\n"
             "OPTIONS:\n"
             "  -o, --output          The output file name\n"
             "  -h, --help            Display available options\n"
@@ -66,7 +75,7 @@ int main(int argc, char** argv) {
         return EXIT_SUCCESS;
     }
 
-    std::string fn, in, out;
+    std::string fn, out;
     for (int i = 1; i < argc; ++i) {
         if (!strcmp(argv[i], "-o") || !strcmp(argv[i], "--output")) {
             out = argv[++i];
@@ -75,32 +84,21 @@ int main(int argc, char** argv) {
         }
     }
 
-    if (out.empty()) {
+    if (out.empty() && fn == "-") {
+        out = "a.s";
+    } else if (out.empty()) {
         size_t pos = fn.rfind('.');
         std::string base = pos != std::string::npos ? fn.substr(0, pos) : fn;
         out = base + ".s";
     }
 
-    std::ifstream file;
-    file.exceptions(std::ifstream::badbit | std::ifstream::failbit);
     try {
-        file.open(fn, std::ios::in);
-
-        file.seekg(0, std::ios::end);
-        const std::size_t length = file.tellg();
-        file.seekg(0, std::ios::beg);
-
-        in.resize(length);
-
-        file.read(in.data(), static_cast<long>(length));
-
-        file.close();
-    } catch (std::ifstream::failure& e) {
+        const SourceFile source{fn};
+        compile(fn, source.text(), out);
+    } catch (std::system_error& e) {
         std::cerr << "Exception opening/reading file: " << e.what() << "\t";
         exit(EXIT_FAILURE);
     }
 
-    compile(fn, in, out);
-
     return 0;
 }
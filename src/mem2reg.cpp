@@ -0,0 +1,184 @@
+#include "mem2reg.h"
+#include <algorithm>
+#include "recursion.h"
+
+using ir::Opcode;
+
+void SlotPromoter::promote(ir::Function& fn_) {
+    fn = &fn_;
+    const size_t blockCount = fn->blocks.size();
+
+    const auto isSlotAccess = [](const ir::Instr& instr) {
+        return (instr.op == Opcode::LOAD || instr.op == Opcode::STORE) && instr.slot >= 0;
+    };
+
+    // A slot read or written as another type than its own stays in memory
+    isPromoted.assign(fn->slots.size(), true);
+    for (const auto& block: fn->blocks) {
+        for (const auto& instr: block.instrs) {
+            if (!isSlotAccess(instr))
+                continue;
+
+            const ir::Value value = instr.op == Opcode::LOAD ? instr.dst : instr.args[0];
+            if (fn->values[value] != fn->slots[instr.slot])
+                isPromoted[instr.slot] = false;
+        }
+    }
+
+    lastStores.assign(blockCount, {});
+    entryValues.assign(blockCount, {});
+    phis.assign(blockCount, {});
+    replacements.clear();
+    zeros.clear();
+
+    for (ir::BlockId id = 0; id < blockCount; ++id) {
+        for (const auto& instr: fn->blocks[id].instrs) {
+            if (instr.op == Opcode::STORE && isSlotAccess(instr) && isPromoted[instr.slot])
+                lastStores[id][instr.slot] = instr.args[0];
+        }
+    }
+
+    for (ir::BlockId id = 0; id < blockCount; ++id) {
+        std::unordered_map<int32_t, ir::Value> current;
+
+        std::erase_if(fn->blocks[id].instrs, [&](const ir::Instr& instr) {
+            if (!isSlotAccess(instr) || !isPromoted[instr.slot])
+                return false;
+
+            if (instr.op == Opcode::STORE) {
+                current[instr.slot] = instr.args[0];
+            } else if (const auto it = current.find(instr.slot); it != current.end()) {
+                replacements[instr.dst] = it->second;
+            } else {
+                replacements[instr.dst] = entryValue(id, instr.slot);
+            }
+            return true;
+        });
+    }
+
+    removeTrivialPhis();
+
+    for (ir::BlockId id = 0; id < blockCount; ++id) {
+        auto& instrs = fn->blocks[id].instrs;
+        instrs.insert(instrs.begin(), phis[id].begin(), phis[id].end());
+    }
+
+    for (const auto& [type, value]: zeros) {
+        auto& instrs = fn->blocks[0].instrs;
+        instrs.insert(instrs.begin(), {.op = Opcode::CONST, .type = type, .dst = value});
+    }
+
+    for (auto& block: fn->blocks) {
+        for (auto& instr: block.instrs) {
+            for (ir::Value& arg: instr.args) {
+                arg = resolve(arg);
+            }
+        }
+    }
+
+    compactSlots();
+}
+
+ir::Value SlotPromoter::entryValue(const ir::BlockId block, const int32_t slot) {
+    if (const auto it = entryValues[block].find(slot); it != entryValues[block].end())
+        return it->second;
+
+    return recursion::guard([&] {
+        const auto& preds = fn->blocks[block].preds;
+        const ir::Type type = fn->slots[slot];
+        ir::Value value;
+
+        if (block == 0 || preds.empty()) {
+            value = zero(type);
+        } else if (preds.size() == 1) {
+            value = exitValue(preds[0], slot);
+        } else {
+            // The phi is known before its operands, so that loops coming back here find it
+            value = fn->values.size();
+            fn->values.push_back(type);
+            entryValues[block][slot] = value;
+
+            const size_t index = phis[block].size();
+            phis[block].push_back({.op = Opcode::PHI, .type = type, .dst = value, .targets = preds});
+
+            std::vector<ir::Value> args;
+            for (const ir::BlockId pred: preds) {
+                args.push_back(exitValue(pred, slot));
+            }
+            phis[block][index].args = std::move(args);
+        }
+
+        entryValues[block][slot] = value;
+        return value;
+    });
+}
+
+ir::Value SlotPromoter::exitValue(const ir::BlockId block, const int32_t slot) {
+    if (const auto it = lastStores[block].find(slot); it != lastStores[block].end())
+        return it->second;
+
+    return entryValue(block, slot);
+}
+
+ir::Value SlotPromoter::zero(const ir::Type type) {
+    if (const auto it = zeros.find(type); it != zeros.end())
+        return it->second;
+
+    const ir::Value value = fn->values.size();
+    fn->values.push_back(type);
+    zeros[type] = value;
+    return value;
+}
+
+ir::Value SlotPromoter::resolve(ir::Value value) {
+    for (auto it = replacements.find(value); it != replacements.end(); it = replacements.find(value)) {
+        value = it->second;
+    }
+    return value;
+}
+
+void SlotPromoter::removeTrivialPhis() {
+    for (bool changed = true; changed;) {
+        changed = false;
+
+        for (auto& blockPhis: phis) {
+            std::erase_if(blockPhis, [&](const ir::Instr& phi) {
+                // The single value coming in besides the phi itself
+                ir::Value same = ir::NONE;
+                for (const ir::Value arg: phi.args) {
+                    const ir::Value value = resolve(arg);
+                    if (value == phi.dst || value == same)
+                        continue;
+                    if (same != ir::NONE)
+                        return false;
+                    same = value;
+                }
+
+                replacements[phi.dst] = same != ir::NONE ? same : zero(phi.type);
+                changed = true;
+                return true;
+            });
+        }
+    }
+}
+
+void SlotPromoter::compactSlots() {
+    std::vector<int32_t> renumbered(fn->slots.size(), -1);
+    std::vector<ir::Type> slots;
+
+    for (size_t slot = 0; slot < fn->slots.size(); ++slot) {
+        if (!isPromoted[slot]) {
+            renumbered[slot] = static_cast<int32_t>(slots.size());
+            slots.push_back(fn->slots[slot]);
+        }
+    }
+
+    for (auto& block: fn->blocks) {
+        for (auto& instr: block.instrs) {
+            if (instr.slot >= 0)
+                instr.slot = renumbered[instr.slot];
+        }
+    }
+
+    fn->slots = std::move(slots);
+}
@@ -0,0 +1,45 @@
+#ifndef MEM2REG_H
+#define MEM2REG_H
+
+#include <unordered_map>
+#include "ir.h"
+
+// Turns the stack slots of locals and parameters into SSA values. Nothing takes the
+// address of a slot, so every slot whose loads and stores agree on its type is promoted.
+// A load becomes the value last stored on the way to it, with a phi where ways carrying
+// different values meet (Braun et al., on the finished control flow graph). Phis left
+// with a single incoming value are replaced by it, and the slots still in use are
+// renumbered.
+class SlotPromoter {
+public:
+    void promote(ir::Function& fn);
+
+private:
+    // Value a slot holds when control enters or leaves a block
+    ir::Value entryValue(ir::BlockId block, int32_t slot);
+
+    ir::Value exitValue(ir::BlockId block, int32_t slot);
+
+    // Zero of a type, read from slots nothing was stored to yet
+    ir::Value zero(ir::Type type);
+
+    // Value standing in for a removed load or phi
+    ir::Value resolve(ir::Value value);
+
+    void removeTrivialPhis();
+
+    void compactSlots();
+
+    ir::Function* fn{};
+    std::vector<bool> isPromoted;
+    // Value last stored to every slot in every block
+    std::vector<std::unordered_map<int32_t, ir::Value> > lastStores;
+    std::vector<std::unordered_map<int32_t, ir::Value> > entryValues;
+    // Phis created at the start of every block
+    std::vector<std::vector<ir::Instr> > phis;
+    std::unordered_map<ir::Value, ir::Value> replacements;
+    // Zeros created, defined at the start of the entry block
+    std::unordered_map<ir::Type, ir::Value> zeros;
+};
+
+#endif //MEM2REG_H
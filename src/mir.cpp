@@ -0,0 +1,92 @@
+#include "mir.h"
+
+namespace mir {
+bool readsDst(const Op op) {
+    switch (op) {
+        case Op::ADD:
+        case Op::SUB:
+        case Op::IMUL:
+        case Op::AND:
+        case Op::OR:
+        case Op::XOR:
+        case Op::ADDSD:
+        case Op::SUBSD:
+        case Op::MULSD:
+        case Op::DIVSD:
+        case Op::IDIV:
+        case Op::CMP:
+        case Op::UCOMISD:
+        case Op::PUSH:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool writesDst(const Op op) {
+    switch (op) {
+        case Op::MOV:
+        case Op::MOVSD:
+        case Op::MOVQ:
+        case Op::MOVZX:
+        case Op::LEA:
+        case Op::CVTSI2SD:
+        case Op::CVTTSD2SI:
+        case Op::ADD:
+        case Op::SUB:
+        case Op::IMUL:
+        case Op::AND:
+        case Op::OR:
+        case Op::XOR:
+        case Op::ADDSD:
+        case Op::SUBSD:
+        case Op::MULSD:
+        case Op::DIVSD:
+        case Op::SETCC:
+            return true;
+        default:
+            return false;
+    }
+}
+
+std::vector<RegisterID> implicitUses(const Instr& instr) {
+    switch (instr.op) {
+        case Op::CQO:
+            return {RAX};
+        case Op::IDIV:
+            return {RAX, RDX};
+        case Op::CALL:
+        case Op::RET: {
+            std::vector<RegisterID> regs;
+            for (int i = 0; i < instr.gprArgs; ++i) {
+                regs.push_back(instr.op == Op::RET ? RAX : paramRegisters[i]);
+            }
+            for (int i = 0; i < instr.sseArgs; ++i) {
+                regs.push_back(instr.op == Op::RET ? xmm0 : paramRegistersSSE[i]);
+            }
+            return regs;
+        }
+        default:
+            return {};
+    }
+}
+
+std::vector<RegisterID> implicitDefs(const Instr& instr) {
+    switch (instr.op) {
+        case Op::CQO:
+            return {RDX};
+        case Op::IDIV:
+            return {RAX, RDX};
+        case Op::CALL: {
+            std::vector<RegisterID> regs;
+            for (uint32_t id = RAX; id <= xmm15; ++id) {
+                if (!isCalleeSaved(id))
+                    regs.push_back(static_cast<RegisterID>(id));
+            }
+            return regs;
+        }
+        default:
+            return {};
+    }
+}
+}
@@ -0,0 +1,145 @@
+#ifndef MIR_H
+#define MIR_H
+
+#include <cstdint>
+#include <vector>
+#include "register.h"
+#include "symbol.h"
+
+// x86-64 instructions in two-address form over virtual registers, produced by instruction
+// selection. Blocks keep the numbering of the IR function they were selected from. The
+// register allocator replaces every virtual register by a physical register or a stack slot.
+namespace mir {
+enum class Op : uint8_t {
+    MOV,
+    MOVSD,
+    MOVQ,
+    MOVZX,
+    LEA,
+    CVTSI2SD,
+    CVTTSD2SI,
+    ADD,
+    SUB,
+    IMUL,
+    AND,
+    OR,
+    XOR,
+    ADDSD,
+    SUBSD,
+    MULSD,
+    DIVSD,
+    // rdx:rax = sign extension of rax
+    CQO,
+    // rax, rdx = rdx:rax / dst, rdx:rax % dst
+    IDIV,
+    CMP,
+    UCOMISD,
+    SETCC,
+    JMP,
+    JCC,
+    PUSH,
+    // Clobbers every caller-saved register
+    CALL,
+    // Epilogue and return
+    RET,
+    // Exit system call of the entry function
+    EXIT
+};
+
+// Condition codes, the unsigned ones test the flags ucomisd sets
+enum class CC : uint8_t {
+    E,
+    NE,
+    L,
+    G,
+    LE,
+    GE,
+    B,
+    A,
+    BE,
+    AE
+};
+
+enum class RegClass : uint8_t {
+    GPR,
+    SSE
+};
+
+struct Operand {
+    enum class Kind : uint8_t {
+        NONE,
+        VREG,
+        PREG,
+        IMM,
+        // Frame slot, below rbp
+        SLOT,
+        GLOBAL,
+        // Incoming argument passed on the stack, above rbp
+        ARG,
+        BLOCK,
+        SYMBOL
+    };
+
+    Kind kind{Kind::NONE};
+    // Register, slot, argument or block number
+    uint32_t id{};
+    int64_t imm{};
+    SymbolId symbol{};
+
+    static Operand vreg(const uint32_t id) { return {.kind = Kind::VREG, .id = id}; }
+    static Operand preg(const RegisterID id) { return {.kind = Kind::PREG, .id = id}; }
+    static Operand immediate(const int64_t n) { return {.kind = Kind::IMM, .imm = n}; }
+    static Operand slot(const uint32_t id) { return {.kind = Kind::SLOT, .id = id}; }
+    static Operand global(const SymbolId name) { return {.kind = Kind::GLOBAL, .symbol = name}; }
+    static Operand arg(const uint32_t id) { return {.kind = Kind::ARG, .id = id}; }
+    static Operand block(const uint32_t id) { return {.kind = Kind::BLOCK, .id = id}; }
+    static Operand function(const SymbolId name) { return {.kind = Kind::SYMBOL, .symbol = name}; }
+
+    [[nodiscard]] bool isReg() const { return kind == Kind::VREG || kind == Kind::PREG; }
+    [[nodiscard]] bool isMem() const { return kind == Kind::SLOT || kind == Kind::GLOBAL || kind == Kind::ARG; }
+};
+
+struct Instr {
+    Op op;
+    CC cc{};
+    Operand dst{};
+    Operand src{};
+    // Argument registers a CALL reads, or the return register a RET reads
+    uint8_t gprArgs{};
+    uint8_t sseArgs{};
+    // Moves next to each other marked parallel read all their sources before writing
+    bool isParallel{false};
+};
+
+struct Block {
+    std::vector<Instr> instrs;
+};
+
+struct Function {
+    SymbolId name;
+    bool isEntry{false};
+    std::vector<Block> blocks{};
+    // Class of every virtual register
+    std::vector<RegClass> vregs{};
+    // Frame slots in use, 8 bytes each
+    uint32_t slots{};
+    // Callee-saved registers the function writes, saved by its prologue
+    std::vector<RegisterID> savedRegisters{};
+};
+
+// Whether the instruction reads or writes its destination operand
+bool readsDst(Op op);
+
+bool writesDst(Op op);
+
+// Physical registers the instruction reads or writes without naming them as operands
+std::vector<RegisterID> implicitUses(const Instr& instr);
+
+std::vector<RegisterID> implicitDefs(const Instr& instr);
+
+inline bool fitsImm32(const int64_t n) {
+    return n >= INT32_MIN && n <= INT32_MAX;
+}
+}
+
+#endif //MIR_H
@@ -1,38 +1,57 @@
 #include "parser.h"
+#include <algorithm>
+#include <charconv>
+#include "recursion.h"
 #include "exceptions.hpp"
 
-Parser::Parser(const char* fn, Lexer& lexer) : lexer(lexer), tokenIndex(-1), fileName(fn) {
+Parser::Parser(const char* fn, Lexer& lexer, Arena& arena) : lexer(lexer), arena(arena), fileName(fn) {
 }
 
-ExprPtr Parser::parse() {
-    advance();
-
-    ExprPtr root = parseExpr();
-    ExprPtr prevExpr = root;
+static std::optional<SymbolId> definedSymbol(const ExprPtr expr) {
+    ExprPtr var{};
 
-    while (currentToken.type != TokenType::EOF_) {
-        ExprPtr currentExpr = parseExpr();
-        prevExpr->child = currentExpr;
-        prevExpr = std::move(currentExpr);
+    if (const auto defun = cast::toDefun(expr)) {
+        var = defun->name;
+    } else if (const auto defvar = cast::toDefvar(expr)) {
+        var = defvar->pair;
+    } else if (const auto defconst = cast::toDefconstant(expr)) {
+        var = defconst->pair;
     }
-    return root;
+
+    if (const auto v = cast::toVar(var))
+        return v->name;
+
+    return std::nullopt;
 }
 
-Token Parser::advance() {
-    ++tokenIndex;
+Program Parser::parse() {
+    Program program;
 
-    if (tokenIndex < lexer.getTokenSize()) {
-        currentToken = lexer.getToken(tokenIndex);
+    advance();
+
+    while (currentToken->type != TokenType::EOF_) {
+        const int begin = currentToken->offset;
+        ExprPtr expr = parseExpr();
+
+        program.forms.push_back({expr, expr->kind, definedSymbol(expr), {begin, formEnd}});
     }
+    return program;
+}
 
+const Token* Parser::advance() {
+    currentToken = lexer.next();
     return currentToken;
 }
 
 ExprPtr Parser::parseExpr() {
+    return recursion::guard([this] { return parseForm(); });
+}
+
+ExprPtr Parser::parseForm() {
     ExprPtr expr;
 
     consume(TokenType::LPAREN, MISSING_PAREN_ERROR);
-    switch (currentToken.type) {
+    switch (currentToken->type) {
         case TokenType::PLUS:
         case TokenType::MINUS:
         case TokenType::DIV:
@@ -89,8 +108,9 @@ ExprPtr Parser::parseExpr() {
             expr = parseReturn();
             break;
         default:
-            throw InvalidSyntaxError(fileName, currentToken.lexeme.c_str(), 0);
+            throw InvalidSyntaxError(fileName, std::string(currentToken->lexeme).c_str(), 0);
     }
+    formEnd = currentToken->offset + 1;
     consume(TokenType::RPAREN, MISSING_PAREN_ERROR);
 
     return expr;
@@ -99,16 +119,16 @@ ExprPtr Parser::parseExpr() {
 ExprPtr Parser::parseSExpr() {
     ExprPtr left, right;
 
-    Token token = currentToken;
+    const Token token = *currentToken;
     advance();
 
-    if (currentToken.type == TokenType::LPAREN) {
+    if (currentToken->type == TokenType::LPAREN) {
         left = parseExpr();
     } else {
         left = parseAtom();
     }
 
-    if (currentToken.type == TokenType::LPAREN) {
+    if (currentToken->type == TokenType::LPAREN) {
         right = parseExpr();
     } else {
         right = parseAtom();
@@ -118,7 +138,7 @@ ExprPtr Parser::parseSExpr() {
         throw InvalidSyntaxError(fileName, ERROR(OP_INVALID_NUMBER_OF_ARGS_ERROR, "NOT", 2), 0);
     }
 
-    return std::make_shared<BinOpExpr>(left, right, token);
+    return arena.make<BinOpExpr>(left, right, token);
 }
 
 ExprPtr Parser::parseDotimes() {
@@ -130,7 +150,7 @@ ExprPtr Parser::parseDotimes() {
     consume(TokenType::LPAREN, ERROR(EXPECTED_ELEMS_NUMBER_ERROR, "DOTIMES"));
     ExprPtr var = parseAtom();
 
-    if (currentToken.type == TokenType::LPAREN) {
+    if (currentToken->type == TokenType::LPAREN) {
         value = parseExpr();
     } else {
         value = parseAtom();
@@ -142,11 +162,11 @@ ExprPtr Parser::parseDotimes() {
     consume(TokenType::RPAREN, MISSING_PAREN_ERROR);
 
 
-    while (currentToken.type == TokenType::LPAREN) {
+    while (currentToken->type == TokenType::LPAREN) {
         statements.push_back(parseExpr());
     }
 
-    return std::make_shared<DotimesExpr>(var, statements);
+    return arena.make<DotimesExpr>(var, statements);
 }
 
 ExprPtr Parser::parseLoop() {
@@ -154,11 +174,11 @@ ExprPtr Parser::parseLoop() {
 
     advance();
 
-    while (currentToken.type == TokenType::LPAREN) {
+    while (currentToken->type == TokenType::LPAREN) {
         sexprs.push_back(parseExpr());
     }
 
-    return std::make_shared<LoopExpr>(sexprs);
+    return arena.make<LoopExpr>(sexprs);
 }
 
 ExprPtr Parser::parseLet() {
@@ -171,18 +191,18 @@ ExprPtr Parser::parseLet() {
     consume(TokenType::LPAREN, ERROR(EXPECTED_ELEMS_NUMBER_ERROR, "LET"));
     for (;;) {
         // Check out (let (x))
-        while (currentToken.type == TokenType::VAR) {
+        while (currentToken->type == TokenType::VAR) {
             var = parseAtom();
             cast::toVar(var)->sType = SymbolType::LOCAL;
             bindings.push_back(var);
         }
 
         // Check out (let ((x 11)) )
-        while (currentToken.type == TokenType::LPAREN) {
+        while (currentToken->type == TokenType::LPAREN) {
             consume(TokenType::LPAREN, MISSING_PAREN_ERROR);
             var = parseAtom();
 
-            if (currentToken.type == TokenType::LPAREN) {
+            if (currentToken->type == TokenType::LPAREN) {
                 value = parseExpr();
             } else {
                 value = parseAtom();
@@ -194,31 +214,31 @@ ExprPtr Parser::parseLet() {
             consume(TokenType::RPAREN, MISSING_PAREN_ERROR);
         }
 
-        if (currentToken.type == TokenType::RPAREN)
+        if (currentToken->type == TokenType::RPAREN)
             break;
     }
     consume(TokenType::RPAREN, MISSING_PAREN_ERROR);
 
-    while (currentToken.type == TokenType::LPAREN) {
+    while (currentToken->type == TokenType::LPAREN) {
         body.push_back(parseExpr());
     }
 
-    return std::make_shared<LetExpr>(bindings, body);
+    return arena.make<LetExpr>(bindings, body);
 }
 
 ExprPtr Parser::parseSetq() {
     ExprPtr var = createVar(SymbolType::UNKNOWN);
-    return std::make_shared<SetqExpr>(var);
+    return arena.make<SetqExpr>(var);
 }
 
 ExprPtr Parser::parseDefvar() {
     ExprPtr var = createVar(SymbolType::GLOBAL);
-    return std::make_shared<DefvarExpr>(var);
+    return arena.make<DefvarExpr>(var);
 }
 
 ExprPtr Parser::parseDefconst() {
     ExprPtr var = createVar(SymbolType::GLOBAL, true);
-    return std::make_shared<DefconstExpr>(var);
+    return arena.make<DefconstExpr>(var);
 }
 
 ExprPtr Parser::parseDefun() {
@@ -231,7 +251,7 @@ ExprPtr Parser::parseDefun() {
 
     // Parse params
     consume(TokenType::LPAREN, MISSING_PAREN_ERROR);
-    while (currentToken.type == TokenType::VAR) {
+    while (currentToken->type == TokenType::VAR) {
         ExprPtr arg = parseAtom();
         cast::toVar(arg)->sType = SymbolType::PARAM;
         args.push_back(arg);
@@ -239,17 +259,17 @@ ExprPtr Parser::parseDefun() {
     consume(TokenType::RPAREN, MISSING_PAREN_ERROR);
     // Parse body
     for (;;) {
-        if (currentToken.type == TokenType::LPAREN) {
+        if (currentToken->type == TokenType::LPAREN) {
             forms.push_back(parseExpr());
         } else {
             forms.push_back(parseAtom());
         }
 
-        if (currentToken.type == TokenType::RPAREN)
+        if (currentToken->type == TokenType::RPAREN)
             break;
     }
 
-    return std::make_shared<DefunExpr>(name, args, forms);
+    return arena.make<DefunExpr>(name, args, forms);
 }
 
 ExprPtr Parser::parseFuncCall() {
@@ -258,7 +278,7 @@ ExprPtr Parser::parseFuncCall() {
     ExprPtr name = parseAtom();
 
     for (;;) {
-        if (currentToken.type == TokenType::LPAREN) {
+        if (currentToken->type == TokenType::LPAREN) {
             args.push_back(parseExpr());
         } else {
             ExprPtr arg = parseAtom();
@@ -269,11 +289,11 @@ ExprPtr Parser::parseFuncCall() {
             args.push_back(arg);
         }
 
-        if (currentToken.type == TokenType::RPAREN)
+        if (currentToken->type == TokenType::RPAREN)
             break;
     }
 
-    return std::make_shared<FuncCallExpr>(name, args);
+    return arena.make<FuncCallExpr>(name, args);
 }
 
 ExprPtr Parser::parseReturn() {
@@ -281,7 +301,7 @@ ExprPtr Parser::parseReturn() {
 
     ExprPtr arg = parseAtom();
 
-    return std::make_shared<ReturnExpr>(arg);
+    return arena.make<ReturnExpr>(arg);
 }
 
 ExprPtr Parser::parseIf() {
@@ -289,25 +309,25 @@ ExprPtr Parser::parseIf() {
 
     advance();
 
-    if (currentToken.type == TokenType::LPAREN) {
+    if (currentToken->type == TokenType::LPAREN) {
         test = parseExpr();
     } else {
         test = parseAtom();
     }
 
-    if (currentToken.type == TokenType::LPAREN) {
+    if (currentToken->type == TokenType::LPAREN) {
         then = parseExpr();
     } else {
         then = parseAtom();
     }
 
-    if (currentToken.type == TokenType::LPAREN) {
+    if (currentToken->type == TokenType::LPAREN) {
         else_ = parseExpr();
     } else {
         else_ = parseAtom();
     }
 
-    return std::make_shared<IfExpr>(test, then, else_);
+    return arena.make<IfExpr>(test, then, else_);
 }
 
 ExprPtr Parser::parseWhen() {
@@ -316,24 +336,24 @@ ExprPtr Parser::parseWhen() {
 
     advance();
 
-    if (currentToken.type == TokenType::LPAREN) {
+    if (currentToken->type == TokenType::LPAREN) {
         test = parseExpr();
     } else {
         test = parseAtom();
     }
 
     for (;;) {
-        if (currentToken.type == TokenType::LPAREN) {
+        if (currentToken->type == TokenType::LPAREN) {
             then.push_back(parseExpr());
         } else {
             then.push_back(parseAtom());
         }
 
-        if (currentToken.type == TokenType::RPAREN)
+        if (currentToken->type == TokenType::RPAREN)
             break;
     }
 
-    return std::make_shared<WhenExpr>(test, then);
+    return arena.make<WhenExpr>(test, then);
 }
 
 ExprPtr Parser::parseCond() {
@@ -342,21 +362,21 @@ ExprPtr Parser::parseCond() {
 
     advance();
 
-    while (currentToken.type == TokenType::LPAREN) {
+    while (currentToken->type == TokenType::LPAREN) {
         consume(TokenType::LPAREN, MISSING_PAREN_ERROR);
 
-        if (currentToken.type == TokenType::LPAREN) {
+        if (currentToken->type == TokenType::LPAREN) {
             test = parseExpr();
         } else {
             test = parseAtom();
         }
 
         std::vector<ExprPtr> statements;
-        if (currentToken.type != TokenType::LPAREN) {
+        if (currentToken->type != TokenType::LPAREN) {
             statements.push_back(parseAtom());
         }
 
-        while (currentToken.type == TokenType::LPAREN) {
+        while (currentToken->type == TokenType::LPAREN) {
             statements.push_back(parseExpr());
         }
 
@@ -364,53 +384,66 @@ ExprPtr Parser::parseCond() {
         consume(TokenType::RPAREN, MISSING_PAREN_ERROR);
     }
 
-    return std::make_shared<CondExpr>(variants);
+    return arena.make<CondExpr>(variants);
 }
 
 ExprPtr Parser::parseAtom() {
-    if (currentToken.type == TokenType::STRING) {
-        Token token = currentToken;
+    if (currentToken->type == TokenType::STRING) {
+        const Token* token = currentToken;
         advance();
-        return std::make_shared<StringExpr>(token.lexeme);
+        return arena.make<StringExpr>(token->lexeme);
     }
 
-    if (currentToken.type == TokenType::VAR) {
-        Token token = currentToken;
+    if (currentToken->type == TokenType::VAR) {
+        const Token* token = currentToken;
         advance();
-        ExprPtr name = std::make_shared<StringExpr>(token.lexeme);
-        ExprPtr value = std::make_shared<Uninitialized>();
-        return std::make_shared<VarExpr>(name, value);
+        ExprPtr value = arena.make<Uninitialized>();
+        return arena.make<VarExpr>(token->symbol, value);
     }
 
-    if (currentToken.type == TokenType::NIL) {
+    if (currentToken->type == TokenType::NIL) {
         advance();
-        return std::make_shared<NILExpr>();
+        return arena.make<NILExpr>();
     }
 
-    if (currentToken.type == TokenType::T) {
+    if (currentToken->type == TokenType::T) {
         advance();
-        return std::make_shared<TExpr>();
+        return arena.make<TExpr>();
     }
 
-    if (currentToken.type == TokenType::RPAREN) {
-        return std::make_shared<Uninitialized>();
+    if (currentToken->type == TokenType::RPAREN) {
+        return arena.make<Uninitialized>();
     }
 
     return parseNumber();
 }
 
 ExprPtr Parser::parseNumber() {
-    const auto token = currentToken;
+    const Token* token = currentToken;
     advance();
 
-    if (token.type == TokenType::INT) {
-        return std::make_shared<IntExpr>(std::stoi(token.lexeme));
+    const char* first = token->lexeme.data();
+    const char* last = first + token->lexeme.size();
+
+    const auto check = [&](const std::from_chars_result result) {
+        if (result.ec == std::errc::result_out_of_range)
+            throw InvalidSyntaxError(fileName, ERROR(NUMBER_RANGE_ERROR, token->lexeme), token->line);
+        if (result.ec != std::errc{} || result.ptr != last)
+            throw InvalidSyntaxError(fileName, EXPECTED_NUMBER_ERROR, token->line);
+    };
+
+    if (token->type == TokenType::INT) {
+        int n{};
+        check(std::from_chars(first, last, n));
+        return arena.make<IntExpr>(n);
     }
-    if (token.type == TokenType::DOUBLE) {
-        return std::make_shared<DoubleExpr>(std::stof(token.lexeme));
+    if (token->type == TokenType::DOUBLE) {
+        double n{};
+        check(std::from_chars(first, last, n));
+        return arena.make<DoubleExpr>(n);
     }
 
-    throw InvalidSyntaxError(fileName, EXPECTED_NUMBER_ERROR, 0);
+    throw InvalidSyntaxError(fileName, EXPECTED_NUMBER_ERROR, token->line);
 }
 
 ExprPtr Parser::createVar(const SymbolType type, const bool isConstant) {
@@ -419,7 +452,7 @@ ExprPtr Parser::createVar(const SymbolType type, const bool isConstant) {
 
     ExprPtr var = parseAtom();
 
-    if (currentToken.type == TokenType::LPAREN) {
+    if (currentToken->type == TokenType::LPAREN) {
         if (isConstant)
             throw InvalidSyntaxError(fileName, ERROR(SEXPR_ERROR, "DEFCONSTANT"), 0);
         value = parseExpr();
@@ -443,6 +476,203 @@ void Parser::consume(const TokenType expected, const char* errorStr) {
 }
 
 void Parser::expect(const TokenType expected, const char* errorStr) const {
-    if (currentToken.type != expected)
+    if (currentToken->type != expected)
         throw InvalidSyntaxError(fileName, errorStr, 0);
 }
+
+static std::vector<ExprPtr> clone(Arena& arena, const std::vector<ExprPtr>& exprs) {
+    std::vector<ExprPtr> copies;
+    copies.reserve(exprs.size());
+
+    for (const auto& expr: exprs) {
+        copies.push_back(clone(arena, expr));
+    }
+
+    return copies;
+}
+
+ExprPtr clone(Arena& arena, const IExpr* expr) {
+    if (!expr) return nullptr;
+
+    return recursion::guard([&]() -> ExprPtr {
+        switch (expr->kind) {
+            case ExprKind::INT:
+                return arena.make<IntExpr>(cast::toInt(expr)->n);
+            case ExprKind::DOUBLE:
+                return arena.make<DoubleExpr>(cast::toDouble(expr)->n);
+            case ExprKind::STRING:
+                return arena.make<StringExpr>(cast::toString(expr)->data);
+            case ExprKind::NIL:
+                return arena.make<NILExpr>();
+            case ExprKind::T:
+                return arena.make<TExpr>();
+            case ExprKind::UNINITIALIZED:
+                return arena.make<Uninitialized>();
+            case ExprKind::BINOP: {
+                const auto binop = cast::toBinop(expr);
+                ExprPtr lhs = clone(arena, binop->lhs);
+                ExprPtr rhs = clone(arena, binop->rhs);
+                return arena.make<BinOpExpr>(lhs, rhs, binop->opToken);
+            }
+            case ExprKind::DOTIMES: {
+                const auto dotimes = cast::toDotimes(expr);
+                ExprPtr iterationCount = clone(arena, dotimes->iterationCount);
+                auto statements = clone(arena, dotimes->statements);
+                return arena.make<DotimesExpr>(iterationCount, statements);
+            }
+            case ExprKind::LOOP: {
+                auto sexprs = clone(arena, cast::toLoop(expr)->sexprs);
+                return arena.make<LoopExpr>(sexprs);
+            }
+            case ExprKind::LET: {
+                const auto let = cast::toLet(expr);
+                auto bindings = clone(arena, let->bindings);
+                auto body = clone(arena, let->body);
+                return arena.make<LetExpr>(bindings, body);
+            }
+            case ExprKind::SETQ: {
+                ExprPtr pair = clone(arena, cast::toSetq(expr)->pair);
+                return arena.make<SetqExpr>(pair);
+            }
+            case ExprKind::DEFVAR: {
+                ExprPtr pair = clone(arena, cast::toDefvar(expr)->pair);
+                return arena.make<DefvarExpr>(pair);
+            }
+            case ExprKind::DEFCONST: {
+                ExprPtr pair = clone(arena, cast::toDefconstant(expr)->pair);
+                return arena.make<DefconstExpr>(pair);
+            }
+            case ExprKind::DEFUN: {
+                const auto defun = cast::toDefun(expr);
+                ExprPtr name = clone(arena, defun->name);
+                auto args = clone(arena, defun->args);
+                auto forms = clone(arena, defun->forms);
+                const auto copy = arena.make<DefunExpr>(name, args, forms);
+                copy->returnType = defun->returnType;
+                return copy;
+            }
+            case ExprKind::FUNCCALL: {
+                const auto funcCall = cast::toFuncCall(expr);
+                ExprPtr name = clone(arena, funcCall->name);
+                auto args = clone(arena, funcCall->args);
+                const auto copy = arena.make<FuncCallExpr>(name, args);
+                copy->callee = funcCall->callee;
+                return copy;
+            }
+            case ExprKind::RETURN: {
+                ExprPtr arg = clone(arena, cast::toReturn(expr)->arg);
+                return arena.make<ReturnExpr>(arg);
+            }
+            case ExprKind::IF: {
+                const auto if_ = cast::toIf(expr);
+                ExprPtr test = clone(arena, if_->test);
+                ExprPtr then = clone(arena, if_->then);
+                return arena.make<IfExpr>(test, then, clone(arena, if_->else_));
+            }
+            case ExprKind::WHEN: {
+                const auto when = cast::toWhen(expr);
+                ExprPtr test = clone(arena, when->test);
+                auto then = clone(arena, when->then);
+                return arena.make<WhenExpr>(test, then);
+            }
+            case ExprKind::COND: {
+                std::vector<std::pair<ExprPtr, std::vector<ExprPtr> > > variants;
+                for (const auto& [test, statements]: cast::toCond(expr)->variants) {
+                    variants.emplace_back(clone(arena, test), clone(arena, statements));
+                }
+                return arena.make<CondExpr>(variants);
+            }
+            case ExprKind::VAR: {
+                const auto var = cast::toVar(expr);
+                ExprPtr value = clone(arena, var->value);
+                const auto copy = arena.make<VarExpr>(var->name, value, var->sType);
+                copy->vType = var->vType;
+                return copy;
+            }
+        }
+
+        return nullptr;
+    });
+}
+
+// Shared by both walks; Node is IExpr* or const IExpr*, and the casts keep its constness
+template<typename Node, typename Visit>
+static void walkTree(const Node expr, const Visit& visit) {
+    if (!expr) return;
+
+    recursion::guard([&] {
+        visit(expr);
+
+        const auto all = [&](const std::vector<ExprPtr>& body) {
+            for (const Node form: body) {
+                walkTree(form, visit);
+            }
+        };
+        // The variable of a binding, then the value bound to it
+        const auto binding = [&](const Node var) {
+            visit(var);
+            walkTree<Node>(cast::toVar(var)->value, visit);
+        };
+
+        switch (expr->kind) {
+            case ExprKind::BINOP:
+                walkTree<Node>(cast::toBinop(expr)->lhs, visit);
+                walkTree<Node>(cast::toBinop(expr)->rhs, visit);
+                break;
+            case ExprKind::DOTIMES:
+                binding(cast::toDotimes(expr)->iterationCount);
+                all(cast::toDotimes(expr)->statements);
+                break;
+            case ExprKind::LOOP:
+                all(cast::toLoop(expr)->sexprs);
+                break;
+            case ExprKind::LET:
+                std::ranges::for_each(cast::toLet(expr)->bindings, binding);
+                all(cast::toLet(expr)->body);
+                break;
+            case ExprKind::SETQ:
+                binding(cast::toSetq(expr)->pair);
+                break;
+            case ExprKind::DEFVAR:
+                binding(cast::toDefvar(expr)->pair);
+                break;
+            case ExprKind::DEFCONST:
+                binding(cast::toDefconstant(expr)->pair);
+                break;
+            case ExprKind::DEFUN:
+                all(cast::toDefun(expr)->forms);
+                break;
+            case ExprKind::FUNCCALL:
+                std::ranges::for_each(cast::toFuncCall(expr)->args, binding);
+                break;
+            case ExprKind::RETURN:
+                walkTree<Node>(cast::toReturn(expr)->arg, visit);
+                break;
+            case ExprKind::IF:
+                walkTree<Node>(cast::toIf(expr)->test, visit);
+                walkTree<Node>(cast::toIf(expr)->then, visit);
+                walkTree<Node>(cast::toIf(expr)->else_, visit);
+                break;
+            case ExprKind::WHEN:
+                walkTree<Node>(cast::toWhen(expr)->test, visit);
+                all(cast::toWhen(expr)->then);
+                break;
+            case ExprKind::COND:
+                for (const auto& [test, statements]: cast::toCond(expr)->variants) {
+                    walkTree<Node>(test, visit);
+                    all(statements);
+                }
+                break;
+            default:
+                break;
+        }
+    });
+}
+
+void walk(const ExprPtr expr, const std::function<void(ExprPtr)>& visit) {
+    walkTree(expr, visit);
+}
+
+void walk(const IExpr* expr, const std::function<void(const IExpr*)>& visit) {
+    walkTree(expr, visit);
+}
@@ -1,8 +1,11 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include <functional>
+#include <optional>
 #include <utility>
-#include <memory>
+#include <vector>
+#include "arena.h"
 #include "lexer.h"
 
 enum class SymbolType {
@@ -21,187 +24,290 @@ enum class VarType {
     T
 };
 
+enum class ExprKind {
+    INT,
+    DOUBLE,
+    STRING,
+    NIL,
+    T,
+    BINOP,
+    DOTIMES,
+    LOOP,
+    LET,
+    SETQ,
+    DEFVAR,
+    DEFCONST,
+    DEFUN,
+    FUNCCALL,
+    RETURN,
+    IF,
+    WHEN,
+    COND,
+    VAR,
+    UNINITIALIZED
+};
+
 struct IExpr {
-    std::shared_ptr<IExpr> child;
+    const ExprKind kind;
 
-    virtual ~IExpr() = default;
+    explicit IExpr(const ExprKind kind_) : kind(kind_) {
+    }
 };
 
-using ExprPtr = std::shared_ptr<IExpr>;
+using ExprPtr = IExpr*;
 
 struct IntExpr final : IExpr {
+    static constexpr ExprKind KIND = ExprKind::INT;
+
     int n;
 
-    explicit IntExpr(const int n_) : n(n_) {
+    explicit IntExpr(const int n_) : IExpr(KIND), n(n_) {
     }
 };
 
 struct DoubleExpr final : IExpr {
+    static constexpr ExprKind KIND = ExprKind::DOUBLE;
+
     double n;
 
-    explicit DoubleExpr(const double n_) : n(n_) {
+    explicit DoubleExpr(const double n_) : IExpr(KIND), n(n_) {
     }
 };
 
 struct StringExpr final : IExpr {
+    static constexpr ExprKind KIND = ExprKind::STRING;
+
     std::string data;
 
-    StringExpr() = default;
+    StringExpr() : IExpr(KIND) {
+    }
 
-    explicit StringExpr(std::string& str) : data(std::move(str)) {
+    explicit StringExpr(const std::string_view str) : IExpr(KIND), data(str) {
     }
 };
 
 struct NILExpr final : IExpr {
+    static constexpr ExprKind KIND = ExprKind::NIL;
+
     const bool value{false};
 
-    NILExpr() = default;
+    NILExpr() : IExpr(KIND) {
+    }
 };
 
 struct TExpr final : IExpr {
+    static constexpr ExprKind KIND = ExprKind::T;
+
     const bool value{true};
 
-    TExpr() = default;
+    TExpr() : IExpr(KIND) {
+    }
 };
 
 struct BinOpExpr final : IExpr {
+    static constexpr ExprKind KIND = ExprKind::BINOP;
+
     ExprPtr lhs;
     ExprPtr rhs;
     Token opToken;
 
-    BinOpExpr(ExprPtr& lhs_, ExprPtr& rhs_, Token opTok) : lhs(std::move(lhs_)),
+    BinOpExpr(ExprPtr& lhs_, ExprPtr& rhs_, Token opTok) : IExpr(KIND),
+                                                           lhs(std::move(lhs_)),
                                                            rhs(std::move(rhs_)),
                                                            opToken(std::move(opTok)) {
     }
 };
 
 struct DotimesExpr final : IExpr {
+    static constexpr ExprKind KIND = ExprKind::DOTIMES;
+
     ExprPtr iterationCount;
     std::vector<ExprPtr> statements;
 
-    DotimesExpr(ExprPtr& iterationCount_, std::vector<ExprPtr>& statements_) : iterationCount(
+    DotimesExpr(ExprPtr& iterationCount_, std::vector<ExprPtr>& statements_) : IExpr(KIND),
+                                                                               iterationCount(
                                                                                    std::move(iterationCount_)),
                                                                                statements(std::move(statements_)) {
     }
 };
 
 struct LoopExpr final : IExpr {
+    static constexpr ExprKind KIND = ExprKind::LOOP;
+
     std::vector<ExprPtr> sexprs;
 
-    explicit LoopExpr(std::vector<ExprPtr>& sexprs_) : sexprs(std::move(sexprs_)) {
+    explicit LoopExpr(std::vector<ExprPtr>& sexprs_) : IExpr(KIND), sexprs(std::move(sexprs_)) {
     }
 };
 
 struct LetExpr final : IExpr {
+    static constexpr ExprKind KIND = ExprKind::LET;
+
     std::vector<ExprPtr> bindings;
     std::vector<ExprPtr> body;
 
-    LetExpr(std::vector<ExprPtr>& bindings_, std::vector<ExprPtr>& body_) : bindings(std::move(bindings_)),
+    LetExpr(std::vector<ExprPtr>& bindings_, std::vector<ExprPtr>& body_) : IExpr(KIND),
+                                                                            bindings(std::move(bindings_)),
                                                                             body(std::move(body_)) {
     }
 };
 
 struct SetqExpr final : IExpr {
+    static constexpr ExprKind KIND = ExprKind::SETQ;
+
     ExprPtr pair;
 
-    explicit SetqExpr(ExprPtr& pair_) : pair(std::move(pair_)) {
+    explicit SetqExpr(ExprPtr& pair_) : IExpr(KIND), pair(std::move(pair_)) {
     }
 };
 
 struct DefvarExpr final : IExpr {
+    static constexpr ExprKind KIND = ExprKind::DEFVAR;
+
     ExprPtr pair;
 
-    explicit DefvarExpr(ExprPtr& pair_) : pair(std::move(pair_)) {
+    explicit DefvarExpr(ExprPtr& pair_) : IExpr(KIND), pair(std::move(pair_)) {
     }
 };
 
 struct DefconstExpr final : IExpr {
+    static constexpr ExprKind KIND = ExprKind::DEFCONST;
+
     ExprPtr pair;
 
-    explicit DefconstExpr(ExprPtr& pair_) : pair(std::move(pair_)) {
+    explicit DefconstExpr(ExprPtr& pair_) : IExpr(KIND), pair(std::move(pair_)) {
     }
 };
 
 struct DefunExpr final : IExpr {
+    static constexpr ExprKind KIND = ExprKind::DEFUN;
+
     ExprPtr name;
     std::vector<ExprPtr> args;
     std::vector<ExprPtr> forms;
+    // Copies resolved for other argument types than this definition
+    std::vector<ExprPtr> specializations;
+    // Inferred from the body; callers and the function itself both use it
+    ExprPtr returnType{};
 
-    DefunExpr(ExprPtr& name_, std::vector<ExprPtr>& params_, std::vector<ExprPtr>& body_) : name(std::move(name_)),
+    DefunExpr(ExprPtr& name_, std::vector<ExprPtr>& params_, std::vector<ExprPtr>& body_) : IExpr(KIND),
+        name(std::move(name_)),
         args(std::move(params_)),
         forms(std::move(body_)) {
     }
 };
 
 struct FuncCallExpr final : IExpr {
+    static constexpr ExprKind KIND = ExprKind::FUNCCALL;
+
     ExprPtr name;
-    ExprPtr returnType;
+    // Specialization of the function picked for the argument types
+    ExprPtr callee{};
     std::vector<ExprPtr> args;
 
-    FuncCallExpr(ExprPtr& name_, std::vector<ExprPtr>& params_) : name(std::move(name_)),
+    FuncCallExpr(ExprPtr& name_, std::vector<ExprPtr>& params_) : IExpr(KIND),
+                                                                  name(std::move(name_)),
                                                                   args(std::move(params_)) {
     }
 };
 
 struct ReturnExpr final : IExpr {
+    static constexpr ExprKind KIND = ExprKind::RETURN;
+
     ExprPtr arg;
 
-    explicit ReturnExpr(ExprPtr& arg_) : arg(std::move(arg_)) {
+    explicit ReturnExpr(ExprPtr& arg_) : IExpr(KIND), arg(std::move(arg_)) {
     }
 };
 
 struct IfExpr final : IExpr {
+    static constexpr ExprKind KIND = ExprKind::IF;
+
     ExprPtr test, then, else_;
 
-    IfExpr(ExprPtr& test_, ExprPtr& then_, ExprPtr e = nullptr) : test(std::move(test_)),
+    IfExpr(ExprPtr& test_, ExprPtr& then_, ExprPtr e = nullptr) : IExpr(KIND),
+                                                                  test(std::move(test_)),
                                                                   then(std::move(then_)),
                                                                   else_(std::move(e)) {
     }
 };
 
 struct WhenExpr final : IExpr {
+    static constexpr ExprKind KIND = ExprKind::WHEN;
+
     ExprPtr test;
     std::vector<ExprPtr> then;
 
-    WhenExpr(ExprPtr& test_, std::vector<ExprPtr>& then_) : test(std::move(test_)),
+    WhenExpr(ExprPtr& test_, std::vector<ExprPtr>& then_) : IExpr(KIND),
+                                                            test(std::move(test_)),
                                                             then(std::move(then_)) {
     }
 };
 
 struct CondExpr final : IExpr {
+    static constexpr ExprKind KIND = ExprKind::COND;
+
     std::vector<std::pair<ExprPtr, std::vector<ExprPtr> > > variants;
 
-    explicit CondExpr(std::vector<std::pair<ExprPtr, std::vector<ExprPtr> > >& variants_) : variants(
-        std::move(variants_)) {
+    explicit CondExpr(std::vector<std::pair<ExprPtr, std::vector<ExprPtr> > >& variants_) : IExpr(KIND),
+        variants(std::move(variants_)) {
     }
 };
 
 struct VarExpr final : IExpr {
-    ExprPtr name;
+    static constexpr ExprKind KIND = ExprKind::VAR;
+
+    SymbolId name;
     ExprPtr value;
     SymbolType sType;
     VarType vType{};
 
-    VarExpr(ExprPtr& name_, ExprPtr& value_, const SymbolType type = SymbolType::UNKNOWN) : name(std::move(name_)),
+    VarExpr(const SymbolId name_, ExprPtr& value_, const SymbolType type = SymbolType::UNKNOWN) : IExpr(KIND),
+        name(name_),
         value(std::move(value_)),
         sType(type) {
     }
 };
 
 struct Uninitialized final : IExpr {
+    static constexpr ExprKind KIND = ExprKind::UNINITIALIZED;
+
+    Uninitialized() : IExpr(KIND) {
+    }
+};
+
+// Byte range [begin, end) of a form in the source text
+struct SourceSpan {
+    int begin{};
+    int end{};
+};
+
+struct Form {
+    ExprPtr expr;
+    ExprKind kind;
+    // Name introduced by defun, defvar and defconstant; none for other forms
+    std::optional<SymbolId> symbol;
+    SourceSpan span;
+};
+
+// Top-level forms in source order
+struct Program {
+    std::vector<Form> forms;
 };
 
 class Parser {
 public:
-    Parser(const char* fn, Lexer& lexer);
+    Parser(const char* fn, Lexer& lexer, Arena& arena);
 
-    ExprPtr parse();
+    Program parse();
 
 private:
-    Token advance();
+    const Token* advance();
 
     ExprPtr parseExpr();
 
+    ExprPtr parseForm();
+
     ExprPtr parseSExpr();
 
     ExprPtr parseDotimes();
@@ -239,91 +345,193 @@ private:
     void expect(TokenType expected, const char* errorStr) const;
 
     Lexer& lexer;
-    Token currentToken{};
-    int tokenIndex;
+    Arena& arena;
+    const Token* currentToken{};
+    // End of the most recently closed form
+    int formEnd{};
     const char* fileName;
 };
 
 namespace cast {
-inline std::shared_ptr<BinOpExpr> toBinop(const ExprPtr& expr) {
-    return std::dynamic_pointer_cast<BinOpExpr>(expr);
+template<typename T>
+T* to(const ExprPtr expr) {
+    return expr && expr->kind == T::KIND ? static_cast<T*>(expr) : nullptr;
+}
+
+template<typename T>
+const T* to(const IExpr* expr) {
+    return expr && expr->kind == T::KIND ? static_cast<const T*>(expr) : nullptr;
+}
+
+inline BinOpExpr* toBinop(const ExprPtr expr) {
+    return to<BinOpExpr>(expr);
 }
 
-inline std::shared_ptr<DotimesExpr> toDotimes(const ExprPtr& expr) {
-    return std::dynamic_pointer_cast<DotimesExpr>(expr);
+inline const BinOpExpr* toBinop(const IExpr* expr) {
+    return to<BinOpExpr>(expr);
 }
 
-inline std::shared_ptr<LoopExpr> toLoop(const ExprPtr& expr) {
-    return std::dynamic_pointer_cast<LoopExpr>(expr);
+inline DotimesExpr* toDotimes(const ExprPtr expr) {
+    return to<DotimesExpr>(expr);
 }
 
-inline std::shared_ptr<LetExpr> toLet(const ExprPtr& expr) {
-    return std::dynamic_pointer_cast<LetExpr>(expr);
+inline const DotimesExpr* toDotimes(const IExpr* expr) {
+    return to<DotimesExpr>(expr);
 }
 
-inline std::shared_ptr<SetqExpr> toSetq(const ExprPtr& expr) {
-    return std::dynamic_pointer_cast<SetqExpr>(expr);
+inline LoopExpr* toLoop(const ExprPtr expr) {
+    return to<LoopExpr>(expr);
 }
 
-inline std::shared_ptr<DefvarExpr> toDefvar(const ExprPtr& expr) {
-    return std::dynamic_pointer_cast<DefvarExpr>(expr);
+inline const LoopExpr* toLoop(const IExpr* expr) {
+    return to<LoopExpr>(expr);
 }
 
-inline std::shared_ptr<DefconstExpr> toDefconstant(const ExprPtr& expr) {
-    return std::dynamic_pointer_cast<DefconstExpr>(expr);
+inline LetExpr* toLet(const ExprPtr expr) {
+    return to<LetExpr>(expr);
 }
 
-inline std::shared_ptr<DefunExpr> toDefun(const ExprPtr& expr) {
-    return std::dynamic_pointer_cast<DefunExpr>(expr);
+inline const LetExpr* toLet(const IExpr* expr) {
+    return to<LetExpr>(expr);
 }
 
-inline std::shared_ptr<FuncCallExpr> toFuncCall(const ExprPtr& expr) {
-    return std::dynamic_pointer_cast<FuncCallExpr>(expr);
+inline SetqExpr* toSetq(const ExprPtr expr) {
+    return to<SetqExpr>(expr);
 }
 
-inline std::shared_ptr<ReturnExpr> toReturn(const ExprPtr& expr) {
-    return std::dynamic_pointer_cast<ReturnExpr>(expr);
+inline const SetqExpr* toSetq(const IExpr* expr) {
+    return to<SetqExpr>(expr);
 }
 
-inline std::shared_ptr<IfExpr> toIf(const ExprPtr& expr) {
-    return std::dynamic_pointer_cast<IfExpr>(expr);
+inline DefvarExpr* toDefvar(const ExprPtr expr) {
+    return to<DefvarExpr>(expr);
 }
 
-inline std::shared_ptr<WhenExpr> toWhen(const ExprPtr& expr) {
-    return std::dynamic_pointer_cast<WhenExpr>(expr);
+inline const DefvarExpr* toDefvar(const IExpr* expr) {
+    return to<DefvarExpr>(expr);
 }
 
-inline std::shared_ptr<CondExpr> toCond(const ExprPtr& expr) {
-    return std::dynamic_pointer_cast<CondExpr>(expr);
+inline DefconstExpr* toDefconstant(const ExprPtr expr) {
+    return to<DefconstExpr>(expr);
 }
 
-inline std::shared_ptr<VarExpr> toVar(const ExprPtr& expr) {
-    return std::dynamic_pointer_cast<VarExpr>(expr);
+inline const DefconstExpr* toDefconstant(const IExpr* expr) {
+    return to<DefconstExpr>(expr);
 }
 
-inline std::shared_ptr<StringExpr> toString(const ExprPtr& expr) {
-    return std::dynamic_pointer_cast<StringExpr>(expr);
+inline DefunExpr* toDefun(const ExprPtr expr) {
+    return to<DefunExpr>(expr);
 }
 
-inline std::shared_ptr<IntExpr> toInt(const ExprPtr& expr) {
-    return std::dynamic_pointer_cast<IntExpr>(expr);
+inline const DefunExpr* toDefun(const IExpr* expr) {
+    return to<DefunExpr>(expr);
 }
 
-inline std::shared_ptr<DoubleExpr> toDouble(const ExprPtr& expr) {
-    return std::dynamic_pointer_cast<DoubleExpr>(expr);
+inline FuncCallExpr* toFuncCall(const ExprPtr expr) {
+    return to<FuncCallExpr>(expr);
 }
 
-inline std::shared_ptr<TExpr> toT(const ExprPtr& expr) {
-    return std::dynamic_pointer_cast<TExpr>(expr);
+inline const FuncCallExpr* toFuncCall(const IExpr* expr) {
+    return to<FuncCallExpr>(expr);
 }
 
-inline std::shared_ptr<NILExpr> toNIL(const ExprPtr& expr) {
-    return std::dynamic_pointer_cast<NILExpr>(expr);
+inline ReturnExpr* toReturn(const ExprPtr expr) {
+    return to<ReturnExpr>(expr);
 }
 
-inline std::shared_ptr<Uninitialized> toUninitialized(const ExprPtr& expr) {
-    return std::dynamic_pointer_cast<Uninitialized>(expr);
+inline const ReturnExpr* toReturn(const IExpr* expr) {
+    return to<ReturnExpr>(expr);
 }
+
+inline IfExpr* toIf(const ExprPtr expr) {
+    return to<IfExpr>(expr);
+}
+
+inline const IfExpr* toIf(const IExpr* expr) {
+    return to<IfExpr>(expr);
+}
+
+inline WhenExpr* toWhen(const ExprPtr expr) {
+    return to<WhenExpr>(expr);
+}
+
+inline const WhenExpr* toWhen(const IExpr* expr) {
+    return to<WhenExpr>(expr);
+}
+
+inline CondExpr* toCond(const ExprPtr expr) {
+    return to<CondExpr>(expr);
+}
+
+inline const CondExpr* toCond(const IExpr* expr) {
+    return to<CondExpr>(expr);
 }
 
+inline VarExpr* toVar(const ExprPtr expr) {
+    return to<VarExpr>(expr);
+}
+
+inline const VarExpr* toVar(const IExpr* expr) {
+    return to<VarExpr>(expr);
+}
+
+inline StringExpr* toString(const ExprPtr expr) {
+    return to<StringExpr>(expr);
+}
+
+inline const StringExpr* toString(const IExpr* expr) {
+    return to<StringExpr>(expr);
+}
+
+inline IntExpr* toInt(const ExprPtr expr) {
+    return to<IntExpr>(expr);
+}
+
+inline const IntExpr* toInt(const IExpr* expr) {
+    return to<IntExpr>(expr);
+}
+
+inline DoubleExpr* toDouble(const ExprPtr expr) {
+    return to<DoubleExpr>(expr);
+}
+
+inline const DoubleExpr* toDouble(const IExpr* expr) {
+    return to<DoubleExpr>(expr);
+}
+
+inline TExpr* toT(const ExprPtr expr) {
+    return to<TExpr>(expr);
+}
+
+inline const TExpr* toT(const IExpr* expr) {
+    return to<TExpr>(expr);
+}
+
+inline NILExpr* toNIL(const ExprPtr expr) {
+    return to<NILExpr>(expr);
+}
+
+inline const NILExpr* toNIL(const IExpr* expr) {
+    return to<NILExpr>(expr);
+}
+
+inline Uninitialized* toUninitialized(const ExprPtr expr) {
+    return to<Uninitialized>(expr);
+}
+
+inline const Uninitialized* toUninitialized(const IExpr* expr) {
+    return to<Uninitialized>(expr);
+}
+}
+
+// Deep copy of a tree. Calls keep pointing at the specialization they resolved to and
+// functions keep their return type; apart from those the copy shares no nodes with the original.
+ExprPtr clone(Arena& arena, const IExpr* expr);
+
+// Calls visit on every node of a tree in pre-order, the variables of bindings included.
+// References to variables are not followed to their definitions.
+void walk(ExprPtr expr, const std::function<void(ExprPtr)>& visit);
+
+void walk(const IExpr* expr, const std::function<void(const IExpr*)>& visit);
+
 #endif
@@ -0,0 +1,75 @@
+#include "recursion.h"
+#include <exception>
+#include <system_error>
+#include <pthread.h>
+
+namespace recursion {
+// Room left on the stack below which recursion moves to a new segment
+static constexpr size_t RED_ZONE = 256 * 1024;
+
+static constexpr size_t SEGMENT_SIZE = 64 * 1024 * 1024;
+
+static thread_local const char* stackEnd = nullptr;
+
+static const char* currentStackEnd() {
+#if defined(__APPLE__)
+    const pthread_t self = pthread_self();
+    return static_cast<const char*>(pthread_get_stackaddr_np(self)) - pthread_get_stacksize_np(self);
+#else
+    pthread_attr_t attr;
+    void* addr = nullptr;
+    size_t size = 0;
+
+    if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+        pthread_attr_getstack(&attr, &addr, &size);
+        pthread_attr_destroy(&attr);
+    }
+
+    return static_cast<const char*>(addr);
+#endif
+}
+
+bool isNearStackEnd() {
+    if (!stackEnd) {
+        stackEnd = currentStackEnd();
+    }
+
+    return static_cast<const char*>(__builtin_frame_address(0)) < stackEnd + RED_ZONE;
+}
+
+void runOnNewSegment(void (*fn)(void*), void* ctx) {
+    struct Segment {
+        void (*fn)(void*);
+        void* ctx;
+        std::exception_ptr error;
+    } segment{fn, ctx, nullptr};
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, SEGMENT_SIZE);
+
+    pthread_t thread;
+    const int rc = pthread_create(&thread, &attr, [](void* arg) -> void* {
+        auto* s = static_cast<Segment*>(arg);
+
+        try {
+            s->fn(s->ctx);
+        } catch (...) {
+            s->error = std::current_exception();
+        }
+
+        return nullptr;
+    }, &segment);
+    pthread_attr_destroy(&attr);
+
+    if (rc != 0) {
+        throw std::system_error(rc, std::generic_category(), "pthread_create");
+    }
+
+    pthread_join(thread, nullptr);
+
+    if (segment.error) {
+        std::rethrow_exception(segment.error);
+    }
+}
+}
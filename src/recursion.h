@@ -0,0 +1,40 @@
+#ifndef RECURSION_H
+#define RECURSION_H
+
+#include <type_traits>
+
+// The parser and the passes recurse once per nesting level of the source. Machine-generated
+// programs can nest far deeper than the native stack allows, so every recursive cycle goes
+// through guard(). When the current stack is close to its end, the rest of the recursion
+// continues on a fresh stack segment, keeping memory linear in the nesting depth.
+namespace recursion {
+bool isNearStackEnd();
+
+void runOnNewSegment(void (*fn)(void*), void* ctx);
+
+template<typename F>
+auto guard(F&& fn) -> decltype(fn()) {
+    if (!isNearStackEnd())
+        return fn();
+
+    using R = decltype(fn());
+
+    if constexpr (std::is_void_v<R>) {
+        runOnNewSegment([](void* ctx) { (*static_cast<std::remove_reference_t<F>*>(ctx))(); }, &fn);
+    } else {
+        struct Task {
+            std::remove_reference_t<F>& fn;
+            R result{};
+        } task{fn};
+
+        runOnNewSegment([](void* ctx) {
+            auto* t = static_cast<Task*>(ctx);
+            t->result = t->fn();
+        }, &task);
+
+        return task.result;
+    }
+}
+}
+
+#endif //RECURSION_H
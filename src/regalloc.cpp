@@ -0,0 +1,609 @@
+#include "regalloc.h"
+#include <algorithm>
+#include <climits>
+
+using mir::Op;
+using mir::Operand;
+using mir::RegClass;
+
+// Destinations that have to be a register
+static bool needsRegDst(const Op op) {
+    switch (op) {
+        case Op::MOVZX:
+        case Op::LEA:
+        case Op::MOVQ:
+        case Op::CVTSI2SD:
+        case Op::CVTTSD2SI:
+        case Op::IMUL:
+        case Op::ADDSD:
+        case Op::SUBSD:
+        case Op::MULSD:
+        case Op::DIVSD:
+        case Op::UCOMISD:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static Op moveOf(const RegClass regClass) {
+    return regClass == RegClass::SSE ? Op::MOVSD : Op::MOV;
+}
+
+// Calls use with every operand the instruction reads, then def with every one it writes
+template<typename Use, typename Def>
+static void visitOperands(const mir::Instr& instr, Use use, Def def) {
+    if (instr.src.isReg())
+        use(instr.src);
+    if (instr.dst.isReg() && mir::readsDst(instr.op))
+        use(instr.dst);
+    for (const RegisterID reg: mir::implicitUses(instr)) {
+        use(Operand::preg(reg));
+    }
+
+    if (instr.dst.isReg() && mir::writesDst(instr.op))
+        def(instr.dst);
+    for (const RegisterID reg: mir::implicitDefs(instr)) {
+        def(Operand::preg(reg));
+    }
+}
+
+// Definition that can be redone wherever the value is read instead of spilling it: a
+// constant, the address of a global, or a double constant from the bits of another value
+static std::optional<mir::Instr> rematOf(const mir::Instr& def) {
+    if ((def.op == Op::MOV && def.src.kind == Operand::Kind::IMM) || def.op == Op::LEA ||
+        (def.op == Op::MOVQ && def.src.kind == Operand::Kind::VREG))
+        return mir::Instr{.op = def.op, .src = def.src};
+    return std::nullopt;
+}
+
+// Whether the instruction is a parallel move followed by another one, sharing its positions
+static bool isGrouped(const std::vector<mir::Instr>& instrs, const size_t i) {
+    return instrs[i].isParallel && i + 1 < instrs.size() && instrs[i + 1].isParallel;
+}
+
+static std::vector<uint32_t> successors(const mir::Block& block) {
+    std::vector<uint32_t> succs;
+    for (const auto& instr: block.instrs) {
+        if (instr.dst.kind == Operand::Kind::BLOCK)
+            succs.push_back(instr.dst.id);
+    }
+    return succs;
+}
+
+void RegisterAllocator::allocate(mir::Function& fn_) {
+    fn = &fn_;
+
+    buildIntervals();
+    computeLiveness();
+    scan();
+
+    // The entry never returns to anyone
+    fn_.savedRegisters.clear();
+    if (!fn_.isEntry) {
+        for (const RegisterID reg: allocatable) {
+            if (isCalleeSaved(reg) && std::ranges::any_of(locations, [&](const Operand& location) {
+                return location.kind == Operand::Kind::PREG && location.id == reg;
+            }))
+                fn_.savedRegisters.push_back(reg);
+        }
+    }
+
+    // Values saved over every instruction, by where the store and the load go
+    std::vector<std::pair<uint32_t, uint32_t>> stores;
+    std::vector<std::pair<uint32_t, uint32_t>> loads;
+    for (uint32_t v = 0; v < fn_.vregs.size(); ++v) {
+        for (const Window& window: saves[v]) {
+            stores.emplace_back(window.first, v);
+            loads.emplace_back(window.last, v);
+        }
+    }
+    std::ranges::sort(stores);
+    std::ranges::sort(loads);
+
+    auto store = stores.begin();
+    auto load = loads.begin();
+    uint32_t index = 0;
+
+    for (auto& block: fn_.blocks) {
+        std::vector<mir::Instr> instrs;
+        instrs.reserve(block.instrs.size());
+
+        for (size_t i = 0; i < block.instrs.size(); ++i) {
+            for (; store != stores.end() && store->first == index; ++store) {
+                const uint32_t v = store->second;
+                instrs.push_back({.op = moveOf(fn_.vregs[v]), .dst = Operand::slot(slotOf[v]), .src = locations[v]});
+            }
+
+            if (block.instrs[i].isParallel) {
+                const size_t first = i;
+                while (isGrouped(block.instrs, i)) {
+                    ++i;
+                }
+                resolveParallelMoves(std::span(block.instrs).subspan(first, i - first + 1), instrs);
+            } else {
+                rewrite(block.instrs[i], instrs);
+            }
+
+            for (; load != loads.end() && load->first == index; ++load) {
+                const uint32_t v = load->second;
+                instrs.push_back({.op = moveOf(fn_.vregs[v]), .dst = locations[v], .src = Operand::slot(slotOf[v])});
+            }
+            ++index;
+        }
+        block.instrs = std::move(instrs);
+    }
+}
+
+void RegisterAllocator::buildIntervals() {
+    const size_t blockCount = fn->blocks.size();
+
+    intervals.assign(fn->vregs.size(), {UINT32_MAX, 0});
+    hints.assign(fn->vregs.size(), RSP);
+    blockRanges.assign(blockCount, {});
+    upwardUses.assign(blockCount, {});
+    defBlocks.assign(fn->vregs.size(), {});
+    usePositions.assign(fn->vregs.size(), {});
+    defPositions.assign(fn->vregs.size(), {});
+    remats.assign(fn->vregs.size(), {});
+    std::vector<uint32_t> defCounts(fn->vregs.size());
+    for (auto& ranges: fixed) {
+        ranges.clear();
+    }
+
+    uint32_t pos = 0;
+    for (uint32_t id = 0; id < blockCount; ++id) {
+        const uint32_t blockStart = pos;
+        // Position every physical register was last written at in the block
+        std::array<uint32_t, REGISTER_COUNT> written;
+        written.fill(blockStart);
+
+        const auto& instrs = fn->blocks[id].instrs;
+        for (size_t i = 0; i < instrs.size(); ++i) {
+            const mir::Instr& instr = instrs[i];
+            visitOperands(instr, [&](const Operand& op) {
+                if (op.kind == Operand::Kind::VREG) {
+                    if (defBlocks[op.id].empty() || defBlocks[op.id].back() != id)
+                        upwardUses[id].push_back(op.id);
+                    usePositions[op.id].push_back(pos);
+                    extend(op.id, pos);
+                } else {
+                    fixed[op.id].push_back({written[op.id], pos});
+                }
+            }, [&](const Operand& op) {
+                if (op.kind == Operand::Kind::VREG) {
+                    if (defBlocks[op.id].empty() || defBlocks[op.id].back() != id)
+                        defBlocks[op.id].push_back(id);
+                    defCounts[op.id]++;
+                    defPositions[op.id].push_back(pos + 1);
+                    extend(op.id, pos + 1);
+                } else {
+                    written[op.id] = pos + 1;
+                    fixed[op.id].push_back({pos + 1, pos + 1});
+                }
+            });
+
+            if (instr.dst.kind == Operand::Kind::VREG && mir::writesDst(instr.op))
+                remats[instr.dst.id] = rematOf(instr);
+
+            if ((instr.op == Op::MOV || instr.op == Op::MOVSD) && instr.dst.isReg() && instr.src.isReg()) {
+                if (instr.dst.kind == Operand::Kind::VREG && instr.src.kind == Operand::Kind::PREG)
+                    hints[instr.dst.id] = static_cast<RegisterID>(instr.src.id);
+                if (instr.src.kind == Operand::Kind::VREG && instr.dst.kind == Operand::Kind::PREG)
+                    hints[instr.src.id] = static_cast<RegisterID>(instr.dst.id);
+            }
+
+            if (!isGrouped(instrs, i))
+                pos += 2;
+        }
+
+        blockRanges[id] = {blockStart, pos - 1};
+    }
+
+    // Only values written once are recomputed, a double constant only when its bits are
+    // read by nothing else
+    for (uint32_t v = 0; v < fn->vregs.size(); ++v) {
+        if (defCounts[v] != 1) {
+            remats[v].reset();
+        } else if (remats[v] && remats[v]->op == Op::MOVQ) {
+            const uint32_t bits = remats[v]->src.id;
+            if (defCounts[bits] == 1 && usePositions[bits].size() == 1 && remats[bits] && remats[bits]->op == Op::MOV) {
+                remats[v]->dst = Operand::vreg(bits);
+                remats[v]->src = remats[bits]->src;
+            } else {
+                remats[v].reset();
+            }
+        }
+    }
+
+    for (uint32_t reg = 0; reg < REGISTER_COUNT; ++reg) {
+        auto& ranges = fixed[reg];
+        std::ranges::sort(ranges, {}, &Interval::start);
+
+        fixedReaches[reg].resize(ranges.size());
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            fixedReaches[reg][i] = std::max(ranges[i].end, i > 0 ? fixedReaches[reg][i - 1] : 0);
+        }
+    }
+}
+
+void RegisterAllocator::computeLiveness() {
+    const size_t blockCount = fn->blocks.size();
+
+    std::vector<std::vector<uint32_t>> preds(blockCount);
+    for (uint32_t id = 0; id < blockCount; ++id) {
+        for (const uint32_t succ: successors(fn->blocks[id])) {
+            preds[succ].push_back(id);
+        }
+    }
+
+    // Every virtual register is followed back from the blocks reading it before any write,
+    // through the predecessors, up to the blocks writing it
+    std::vector<uint32_t> visited(blockCount, UINT32_MAX);
+    liveOut.assign(fn->vregs.size(), {});
+    std::vector<std::vector<uint32_t>> usedIn(fn->vregs.size());
+    for (uint32_t id = 0; id < blockCount; ++id) {
+        for (const uint32_t vreg: upwardUses[id]) {
+            usedIn[vreg].push_back(id);
+        }
+    }
+
+    for (uint32_t vreg = 0; vreg < fn->vregs.size(); ++vreg) {
+        std::vector<uint32_t> worklist = std::move(usedIn[vreg]);
+
+        while (!worklist.empty()) {
+            const uint32_t id = worklist.back();
+            worklist.pop_back();
+            if (visited[id] == vreg)
+                continue;
+            visited[id] = vreg;
+            extend(vreg, blockRanges[id].start);
+
+            for (const uint32_t pred: preds[id]) {
+                extend(vreg, blockRanges[pred].end);
+                liveOut[vreg].push_back(pred);
+                if (std::ranges::find(defBlocks[vreg], pred) == defBlocks[vreg].end())
+                    worklist.push_back(pred);
+            }
+        }
+
+        std::ranges::sort(liveOut[vreg]);
+        const auto [first, last] = std::ranges::unique(liveOut[vreg]);
+        liveOut[vreg].erase(first, last);
+    }
+}
+
+void RegisterAllocator::extend(const uint32_t vreg, const uint32_t pos) {
+    intervals[vreg].start = std::min(intervals[vreg].start, pos);
+    intervals[vreg].end = std::max(intervals[vreg].end, pos);
+}
+
+void RegisterAllocator::scan() {
+    locations.assign(fn->vregs.size(), {});
+    isRematerialized.assign(fn->vregs.size(), false);
+    saves.assign(fn->vregs.size(), {});
+
+    std::vector<uint32_t> order;
+    for (uint32_t v = 0; v < fn->vregs.size(); ++v) {
+        if (intervals[v].start != UINT32_MAX)
+            order.push_back(v);
+    }
+    std::ranges::stable_sort(order, {}, [&](const uint32_t v) { return intervals[v].start; });
+
+    // Values that are not recomputed get a slot once every spill is known
+    std::vector<uint32_t> spilled;
+    const auto spill = [&](const uint32_t vreg) {
+        locations[vreg] = {};
+        saves[vreg].clear();
+        if (!remats[vreg]) {
+            spilled.push_back(vreg);
+            return;
+        }
+
+        isRematerialized[vreg] = true;
+        // The bits of a double constant are not needed anymore either
+        if (remats[vreg]->op == Op::MOVQ)
+            isRematerialized[remats[vreg]->dst.id] = true;
+    };
+
+    // Virtual registers holding a register, in no particular order
+    std::vector<uint32_t> active;
+
+    for (const uint32_t v: order) {
+        const Interval& interval = intervals[v];
+        const bool isSSEClass = fn->vregs[v] == RegClass::SSE;
+
+        std::erase_if(active, [&](const uint32_t other) { return intervals[other].end < interval.start; });
+
+        const auto isUnused = [&](const RegisterID reg) {
+            return isSSE(reg) == isSSEClass &&
+                   std::ranges::none_of(active, [&](const uint32_t other) { return locations[other].id == reg; });
+        };
+        const auto isAvailable = [&](const RegisterID reg) { return isUnused(reg) && isFree(reg, interval); };
+
+        RegisterID chosen = RSP;
+        if (hints[v] != RSP && std::ranges::find(allocatable, hints[v]) != std::end(allocatable) &&
+            isAvailable(hints[v])) {
+            chosen = hints[v];
+        } else if (const auto it = std::ranges::find_if(allocatable, isAvailable); it != std::end(allocatable)) {
+            chosen = *it;
+        } else if (!remats[v]) {
+            // Saving costs a store and a load per window, spilling a store and a load per read
+            size_t fewest = usePositions[v].size() / 2 + 1;
+            for (const RegisterID reg: allocatable) {
+                if (isCalleeSaved(reg) || !isUnused(reg))
+                    continue;
+
+                if (auto windows = saveWindows(reg, v); windows && windows->size() < fewest) {
+                    chosen = reg;
+                    fewest = windows->size();
+                    saves[v] = std::move(*windows);
+                }
+            }
+        }
+
+        if (chosen != RSP) {
+            locations[v] = Operand::preg(chosen);
+            active.push_back(v);
+            continue;
+        }
+
+        // Out of registers, the value read again furthest from here goes to memory
+        auto victim = active.end();
+        uint32_t furthest = nextUse(v, interval.start);
+        for (auto it = active.begin(); it != active.end(); ++it) {
+            const auto reg = static_cast<RegisterID>(locations[*it].id);
+            if (isSSE(reg) != isSSEClass || !isFree(reg, interval))
+                continue;
+
+            if (const uint32_t next = nextUse(*it, interval.start); next > furthest) {
+                victim = it;
+                furthest = next;
+            }
+        }
+
+        if (victim != active.end()) {
+            locations[v] = locations[*victim];
+            spill(*victim);
+            *victim = v;
+        } else {
+            spill(v);
+        }
+    }
+
+    // Saved values take slots like the spilled ones, which are kept there
+    std::vector<uint32_t> slotted = spilled;
+    for (uint32_t v = 0; v < fn->vregs.size(); ++v) {
+        if (!saves[v].empty())
+            slotted.push_back(v);
+    }
+    assignSlots(slotted);
+
+    for (const uint32_t v: spilled) {
+        locations[v] = Operand::slot(slotOf[v]);
+    }
+}
+
+void RegisterAllocator::assignSlots(std::vector<uint32_t>& vregs) {
+    std::ranges::sort(vregs, {}, [&](const uint32_t v) { return intervals[v].start; });
+    slotOf.assign(fn->vregs.size(), 0);
+
+    // Slots of values still live, and those free again
+    std::vector<uint32_t> active;
+    std::vector<uint32_t> freeSlots;
+
+    for (const uint32_t v: vregs) {
+        std::erase_if(active, [&](const uint32_t other) {
+            if (intervals[other].end >= intervals[v].start)
+                return false;
+            freeSlots.push_back(slotOf[other]);
+            return true;
+        });
+
+        if (freeSlots.empty()) {
+            slotOf[v] = fn->slots++;
+        } else {
+            slotOf[v] = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        active.push_back(v);
+    }
+}
+
+uint32_t RegisterAllocator::nextUse(const uint32_t vreg, const uint32_t pos) const {
+    // A value live around a loop with no read left before its end is read again on the next turn
+    const auto& uses = usePositions[vreg];
+    const auto it = std::ranges::lower_bound(uses, pos);
+    return it != uses.end() ? *it : intervals[vreg].end;
+}
+
+bool RegisterAllocator::isFree(const RegisterID reg, const Interval& interval) const {
+    // The ranges starting up to the end of the interval overlap it when one reaches its start
+    const auto& ranges = fixed[reg];
+    const auto it = std::ranges::upper_bound(ranges, interval.end, {}, &Interval::start);
+    return it == ranges.begin() || fixedReaches[reg][it - ranges.begin() - 1] < interval.start;
+}
+
+std::optional<std::vector<RegisterAllocator::Window>> RegisterAllocator::saveWindows(const RegisterID reg,
+                                                                                     const uint32_t vreg) const {
+    const Interval& interval = intervals[vreg];
+    const auto& ranges = fixed[reg];
+    std::vector<Window> windows;
+
+    const auto isInside = [](const std::vector<uint32_t>& positions, const uint32_t from, const uint32_t to) {
+        const auto it = std::ranges::lower_bound(positions, from);
+        return it != positions.end() && *it <= to;
+    };
+
+    // The register is taken from before the instruction writing it to after the last one
+    // reading it, the value may be read by the first one still
+    Interval current{UINT32_MAX, 0};
+    const auto close = [&] {
+        const Window window{current.start / 2, current.end / 2};
+        if (isInside(usePositions[vreg], current.start, window.last * 2 + 1) ||
+            isInside(defPositions[vreg], window.first * 2, window.last * 2 + 1))
+            return false;
+
+        if (isLiveAfter(vreg, window.last * 2 + 1))
+            windows.push_back(window);
+        return true;
+    };
+
+    // Ranges on neighbouring instructions make one window
+    auto it = std::ranges::lower_bound(fixedReaches[reg], interval.start);
+    for (size_t i = it - fixedReaches[reg].begin(); i < ranges.size() && ranges[i].start <= interval.end; ++i) {
+        if (ranges[i].end < interval.start)
+            continue;
+
+        if (current.start != UINT32_MAX && ranges[i].start / 2 <= current.end / 2 + 1) {
+            current.end = std::max(current.end, ranges[i].end);
+            continue;
+        }
+
+        if (current.start != UINT32_MAX && !close())
+            return std::nullopt;
+        current = ranges[i];
+    }
+
+    if (current.start != UINT32_MAX && !close())
+        return std::nullopt;
+    return windows;
+}
+
+bool RegisterAllocator::isLiveAfter(const uint32_t vreg, const uint32_t pos) const {
+    const auto block = std::ranges::upper_bound(blockRanges, pos, {}, &Interval::start) - 1;
+
+    const auto& uses = usePositions[vreg];
+    const auto& defs = defPositions[vreg];
+    const auto use = std::ranges::upper_bound(uses, pos);
+    const auto def = std::ranges::upper_bound(defs, pos);
+
+    // An instruction reads its operands before writing them
+    if (use != uses.end() && *use <= block->end)
+        return def == defs.end() || *use < *def;
+
+    return (def == defs.end() || *def > block->end) &&
+           std::ranges::binary_search(liveOut[vreg], static_cast<uint32_t>(block - blockRanges.begin()));
+}
+
+void RegisterAllocator::rewrite(const mir::Instr& instr, std::vector<mir::Instr>& out) const {
+    // Recomputed values are written wherever they are read instead
+    if (instr.dst.kind == Operand::Kind::VREG && isRematerialized[instr.dst.id] && mir::writesDst(instr.op))
+        return;
+
+    mir::Instr rewritten = instr;
+    rewritten.dst = locationOf(instr.dst);
+    rewritten.src = locationOf(instr.src);
+
+    if (instr.src.kind == Operand::Kind::VREG && isRematerialized[instr.src.id])
+        rewritten.src = rematerialize(instr.src.id, scratchSrc, out);
+    if (instr.dst.kind == Operand::Kind::VREG && isRematerialized[instr.dst.id])
+        rewritten.dst = rematerialize(instr.dst.id, scratchDst, out);
+
+    const bool isBigImm = instr.src.kind == Operand::Kind::IMM && !mir::fitsImm32(instr.src.imm);
+    std::vector<mir::Instr> after;
+
+    if (instr.dst.kind == Operand::Kind::VREG && rewritten.dst.isMem() &&
+        (needsRegDst(instr.op) || rewritten.src.isMem() || isBigImm)) {
+        const RegClass regClass = fn->vregs[instr.dst.id];
+        const Operand scratch = Operand::preg(scratchDst[static_cast<int>(regClass)]);
+
+        if (mir::readsDst(instr.op))
+            out.push_back({.op = moveOf(regClass), .dst = scratch, .src = rewritten.dst});
+        if (mir::writesDst(instr.op))
+            after.push_back({.op = moveOf(regClass), .dst = rewritten.dst, .src = scratch});
+
+        rewritten.dst = scratch;
+    }
+
+    // movq only moves between a general purpose and an SSE register
+    if (rewritten.src.isMem() && instr.src.kind == Operand::Kind::VREG &&
+        (rewritten.dst.isMem() || instr.op == Op::MOVQ)) {
+        const RegClass regClass = fn->vregs[instr.src.id];
+        const Operand scratch = Operand::preg(scratchSrc[static_cast<int>(regClass)]);
+
+        out.push_back({.op = moveOf(regClass), .dst = scratch, .src = rewritten.src});
+        rewritten.src = scratch;
+    }
+
+    // Moves between values that ended up in the same register vanish
+    const bool isSelfMove = (rewritten.op == Op::MOV || rewritten.op == Op::MOVSD) &&
+                            rewritten.dst.kind == Operand::Kind::PREG && rewritten.src.kind == Operand::Kind::PREG &&
+                            rewritten.dst.id == rewritten.src.id;
+    if (!isSelfMove)
+        out.push_back(rewritten);
+    out.insert(out.end(), after.begin(), after.end());
+}
+
+void RegisterAllocator::resolveParallelMoves(const std::span<const mir::Instr> moves,
+                                             std::vector<mir::Instr>& out) const {
+    // Moves between registers are ordered first, the others read no register
+    std::vector<mir::Instr> pending;
+    std::vector<mir::Instr> others;
+    for (const auto& move: moves) {
+        const bool isRecomputed = move.src.kind == Operand::Kind::VREG && isRematerialized[move.src.id];
+        const Operand src = locationOf(move.src);
+
+        if (isRecomputed || src.kind != Operand::Kind::PREG) {
+            others.push_back(move);
+        } else if (src.id != move.dst.id) {
+            pending.push_back({.op = move.op, .dst = move.dst, .src = src});
+        }
+    }
+
+    while (!pending.empty()) {
+        const auto isRead = [&](const Operand& reg) {
+            return std::ranges::any_of(pending, [&](const mir::Instr& move) { return move.src.id == reg.id; });
+        };
+
+        // A move whose destination nobody reads anymore goes next
+        if (const auto it = std::ranges::find_if(pending, [&](const mir::Instr& move) { return !isRead(move.dst); });
+            it != pending.end()) {
+            out.push_back(*it);
+            pending.erase(it);
+            continue;
+        }
+
+        // Only cycles are left, one source is set aside in a scratch register to break one
+        const Operand reg = pending.front().src;
+        const Operand scratch = Operand::preg(scratchSrc[isSSE(static_cast<RegisterID>(reg.id))]);
+        out.push_back({.op = pending.front().op, .dst = scratch, .src = reg});
+        for (auto& move: pending) {
+            if (move.src.id == reg.id)
+                move.src = scratch;
+        }
+    }
+
+    for (const auto& move: others) {
+        // Constants and addresses are recomputed right into the argument register
+        if (move.src.kind == Operand::Kind::VREG && isRematerialized[move.src.id] &&
+            remats[move.src.id]->op != Op::MOVQ) {
+            out.push_back({.op = remats[move.src.id]->op, .dst = move.dst, .src = remats[move.src.id]->src});
+        } else {
+            rewrite(move, out);
+        }
+    }
+}
+
+Operand RegisterAllocator::rematerialize(const uint32_t vreg, const RegisterID (&scratch)[2],
+                                         std::vector<mir::Instr>& out) const {
+    const mir::Instr& remat = *remats[vreg];
+    const Operand gpr = Operand::preg(scratch[0]);
+
+    if (remat.op != Op::MOVQ) {
+        out.push_back({.op = remat.op, .dst = gpr, .src = remat.src});
+        return gpr;
+    }
+
+    const Operand sse = Operand::preg(scratch[1]);
+    out.push_back({.op = Op::MOV, .dst = gpr, .src = remat.src});
+    out.push_back({.op = Op::MOVQ, .dst = sse, .src = gpr});
+    return sse;
+}
+
+Operand RegisterAllocator::locationOf(const Operand& operand) const {
+    if (operand.kind != Operand::Kind::VREG)
+        return operand;
+
+    return locations[operand.id];
+}
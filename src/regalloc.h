@@ -0,0 +1,118 @@
+#ifndef REGALLOC_H
+#define REGALLOC_H
+
+#include <array>
+#include <optional>
+#include <span>
+#include "mir.h"
+
+// Linear scan register allocation. Every virtual register gets a single live interval,
+// from its first to its last position, stretched over the blocks it is live through.
+// Intervals take a register in order of their start; when none is left, the value read
+// again furthest away is spilled for its whole life. Constants and addresses of globals
+// are recomputed where they are read, other spilled values share the frame slots of
+// those no longer live. A register is first looked for among those with no fixed use,
+// like an argument, a division or a call clobbering it, overlapping the interval, so
+// values living across calls end up in callee-saved registers. Failing that, a
+// caller-saved register whose fixed uses fall between the reads of the value keeps it,
+// stored to a slot before those it is still live after and loaded back once they are
+// done. Instructions that cannot take a memory operand where a slot ends up go through
+// the scratch registers, which are never handed out. Parallel moves are ordered once
+// their registers are known, a cycle among them goes through a scratch register.
+class RegisterAllocator {
+public:
+    void allocate(mir::Function& fn);
+
+private:
+    struct Interval {
+        uint32_t start;
+        uint32_t end;
+    };
+
+    // Instructions a register holds a fixed operand over while the value it keeps otherwise
+    // is saved, from the first to the last
+    struct Window {
+        uint32_t first;
+        uint32_t last;
+    };
+
+    // Intervals covering the positions of every virtual register inside the blocks
+    void buildIntervals();
+
+    // Stretches the intervals over the blocks every virtual register is live through
+    void computeLiveness();
+
+    void extend(uint32_t vreg, uint32_t pos);
+
+    void scan();
+
+    // Gives the values a slot each, shared with those whose intervals do not overlap
+    void assignSlots(std::vector<uint32_t>& vregs);
+
+    // First position from pos on where the virtual register is read
+    [[nodiscard]] uint32_t nextUse(uint32_t vreg, uint32_t pos) const;
+
+    // Whether the register holds no fixed operand during the interval
+    [[nodiscard]] bool isFree(RegisterID reg, const Interval& interval) const;
+
+    // Windows the value has to be saved over to stay in the register, none when its reads
+    // or writes fall inside one of them
+    [[nodiscard]] std::optional<std::vector<Window>> saveWindows(RegisterID reg, uint32_t vreg) const;
+
+    // Whether the value is read again after pos before it is written
+    [[nodiscard]] bool isLiveAfter(uint32_t vreg, uint32_t pos) const;
+
+    void rewrite(const mir::Instr& instr, std::vector<mir::Instr>& out) const;
+
+    // Orders a group of parallel moves so that no source is overwritten before it is read
+    void resolveParallelMoves(std::span<const mir::Instr> moves, std::vector<mir::Instr>& out) const;
+
+    // Recomputes a value into one of the scratch registers, a double going through both
+    mir::Operand rematerialize(uint32_t vreg, const RegisterID (&scratch)[2], std::vector<mir::Instr>& out) const;
+
+    [[nodiscard]] mir::Operand locationOf(const mir::Operand& operand) const;
+
+    mir::Function* fn{};
+    // Positions of the first and the last instruction of every block
+    std::vector<Interval> blockRanges;
+    // Virtual registers every block reads before writing them
+    std::vector<std::vector<uint32_t>> upwardUses;
+    // Blocks writing every virtual register
+    std::vector<std::vector<uint32_t>> defBlocks;
+    // Live interval of every virtual register. Every instruction takes two positions,
+    // it reads its operands at the first and writes them at the second
+    std::vector<Interval> intervals;
+    // Blocks every virtual register is live out of, in order
+    std::vector<std::vector<uint32_t>> liveOut;
+    // Ranges where a physical register holds a fixed operand, ordered by start
+    std::array<std::vector<Interval>, REGISTER_COUNT> fixed;
+    // Furthest end of the ranges up to every one of them, see isFree
+    std::array<std::vector<uint32_t>, REGISTER_COUNT> fixedReaches;
+    // Positions every virtual register is read and written at, in order
+    std::vector<std::vector<uint32_t>> usePositions;
+    std::vector<std::vector<uint32_t>> defPositions;
+    // Single definition of every virtual register that can be redone instead of spilling,
+    // the bits of a double constant are kept in dst
+    std::vector<std::optional<mir::Instr>> remats;
+    std::vector<bool> isRematerialized;
+    // Register a virtual register is moved from or to, tried first
+    std::vector<RegisterID> hints;
+    std::vector<mir::Operand> locations;
+    // Windows every virtual register kept in a caller-saved register is saved over
+    std::vector<std::vector<Window>> saves;
+    // Slot of every spilled or saved virtual register
+    std::vector<uint32_t> slotOf;
+
+    // Caller-saved registers except the scratch ones come first, the callee-saved ones cost
+    // a save in the prologue and are left for values living across calls
+    static constexpr RegisterID allocatable[] = {
+        RAX, RCX, RDX, RSI, RDI, R8, R9, RBX, R12, R13, R14, R15,
+        xmm0, xmm1, xmm2, xmm3, xmm4, xmm5, xmm6, xmm7, xmm8, xmm9, xmm10, xmm11, xmm12, xmm13
+    };
+
+    static constexpr RegisterID scratchDst[] = {R10, xmm14};
+
+    static constexpr RegisterID scratchSrc[] = {R11, xmm15};
+};
+
+#endif //REGALLOC_H
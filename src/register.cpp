@@ -1,38 +1,40 @@
 #include "register.h"
 
-Register* RegisterAllocator::alloc(const uint8_t rt) {
-    if (rt == SSE) {
-        return scan(priorityOrderSSE, 2);
-    }
-
-    return scan(priorityOrder, 3);
-}
-
-void RegisterAllocator::free(Register* reg) {
-    reg->status &= ~INUSE;
-}
-
-const char* RegisterAllocator::nameFromReg(const Register* reg, const uint32_t size) {
-    return registerNames[reg->id][size];
-}
-
-const char* RegisterAllocator::nameFromID(const uint32_t id, const uint32_t size) {
+static constexpr const char* registerNames[REGISTER_COUNT][SIZE_COUNT] = {
+    {"rax", "eax", "ax", "ah", "al"},
+    {"rdi", "edi", "di", "", "dil"},
+    {"rsi", "esi", "si", "", "sil"},
+    {"rdx", "edx", "dx", "dh", "dl"},
+    {"rcx", "ecx", "cx", "ch", "cl"},
+    {"r8", "r8d", "r8w", "", "r8b"},
+    {"r9", "r9d", "r9w", "", "r9b"},
+    {"r10", "r10d", "r10w", "", "r10b"},
+    {"r11", "r11d", "r11w", "", "r11b"},
+    {"rbp", "ebp", "bp", "", "bpl"},
+    {"rsp", "esp", "sp", "", "spl"},
+    {"rbx", "ebx", "bx", "bh", "bl"},
+    {"r12", "r12d", "r12w", "", "r12b"},
+    {"r13", "r13d", "r13w", "", "r13b"},
+    {"r14", "r14d", "r14w", "", "r14b"},
+    {"r15", "r15d", "r15w", "", "r15b"},
+    {"xmm0", "", "", "", ""},
+    {"xmm1", "", "", "", ""},
+    {"xmm2", "", "", "", ""},
+    {"xmm3", "", "", "", ""},
+    {"xmm4", "", "", "", ""},
+    {"xmm5", "", "", "", ""},
+    {"xmm6", "", "", "", ""},
+    {"xmm7", "", "", "", ""},
+    {"xmm8", "", "", "", ""},
+    {"xmm9", "", "", "", ""},
+    {"xmm10", "", "", "", ""},
+    {"xmm11", "", "", "", ""},
+    {"xmm12", "", "", "", ""},
+    {"xmm13", "", "", "", ""},
+    {"xmm14", "", "", "", ""},
+    {"xmm15", "", "", "", ""},
+};
+
+const char* registerName(const uint32_t id, const RegisterSize size) {
     return registerNames[id][size];
 }
-
-Register* RegisterAllocator::regFromID(const uint32_t id) {
-    return &registers[id];
-}
-
-Register* RegisterAllocator::scan(const uint32_t* priorityOrder, const int size) {
-    for (int i = 0; i < size; ++i) {
-        for (auto& register_: registers) {
-            if (priorityOrder[i] == register_.rType && !isINUSE(register_.status)) {
-                register_.status |= INUSE;
-                return &register_;
-            }
-        }
-    }
-
-    return nullptr;
-}
@@ -1,168 +1,168 @@
 #include "semantic.h"
 #include "exceptions.hpp"
+#include "recursion.h"
 
-void ScopeTracker::enter(const std::string& scopeName) {
-    std::unordered_map<std::string, Symbol> scope;
-    symbolTable.push(scope);
+void ScopeTracker::enter() {
+    scopeStarts.push_back(undoLog.size());
+}
 
-    if (!scopeName.empty()) {
-        scopeNames.push(scopeName);
-    }
+void ScopeTracker::enter(const SymbolId scopeName) {
+    enter();
+    scopeNames.push(scopeName);
 }
 
 void ScopeTracker::exit(const bool isFunc) {
-    symbolTable.pop();
+    while (undoLog.size() > scopeStarts.back()) {
+        symbolTable[static_cast<size_t>(undoLog.back())].pop_back();
+        undoLog.pop_back();
+    }
+    scopeStarts.pop_back();
 
     if (isFunc) {
         scopeNames.pop();
     }
 }
 
-std::string& ScopeTracker::scopeName() {
+SymbolId ScopeTracker::scopeName() const {
     return scopeNames.top();
 }
 
 size_t ScopeTracker::level() const {
-    return symbolTable.size();
+    return scopeStarts.size();
 }
 
-void ScopeTracker::bind(const std::string& name, const Symbol& symbol) {
+void ScopeTracker::bind(const SymbolId name, const Symbol& symbol) {
     if (lookup(name).value) {
         update(name, symbol);
-    } else {
-        auto currentScope = symbolTable.top();
-        symbolTable.pop();
-
-        currentScope.emplace(name, symbol);
-        symbolTable.push(currentScope);
+        return;
     }
+
+    declare(name, symbol);
 }
 
-void ScopeTracker::update(const std::string& name, const Symbol& symbol) {
-    std::stack<ScopeType> scopes;
-  
-    while (!symbolTable.empty()) {
-        ScopeType scope = symbolTable.top();
-        symbolTable.pop();
-        
-        if (scope.contains(name)) {
-            scope[name] = symbol;
-            scopes.push(scope);
-            break;
-        }
-        // If the symbol is not found, push the scope back to the stack
-        // and continue searching in the next scope
-        scopes.push(scope);
+// Binds in the current scope, shadowing any outer binding of the name
+void ScopeTracker::declare(const SymbolId name, const Symbol& symbol) {
+    const auto id = static_cast<size_t>(name);
+    if (id >= symbolTable.size()) {
+        symbolTable.resize(id + 1);
     }
 
-    // reconstruct the scopes
-    while (!scopes.empty()) {
-        symbolTable.push(scopes.top());
-        scopes.pop();
+    if (auto& stack = symbolTable[id]; stack.empty() || stack.back().level != level()) {
+        stack.push_back({symbol, level()});
+        undoLog.push_back(name);
+    } else {
+        stack.back().symbol = symbol;
     }
 }
 
-Symbol ScopeTracker::lookup(const std::string& name) {
-    Symbol sym{};
-    std::stack<ScopeType> scopes;
-
-    while (!symbolTable.empty()) {
-        ScopeType scope = symbolTable.top();
-        symbolTable.pop();
-        scopes.push(scope);
-
-        if (scope.contains(name)) {
-            sym = scope[name];
-            break;
-        }
-        
+void ScopeTracker::update(const SymbolId name, const Symbol& symbol) {
+    if (const auto stack = bindings(name)) {
+        stack->back().symbol = symbol;
     }
-    // reconstruct the scopes
-    while (!scopes.empty()) {
-        symbolTable.push(scopes.top());
-        scopes.pop();
+}
+
+Symbol ScopeTracker::lookup(const SymbolId name) {
+    if (const auto stack = bindings(name)) {
+        return stack->back().symbol;
     }
 
-    return sym;
+    return {};
 }
 
-Symbol ScopeTracker::lookupCurrent(const std::string& name) {
-    if (ScopeType currentScope = symbolTable.top(); currentScope.contains(name)) {
-        return currentScope[name];
+Symbol ScopeTracker::lookupCurrent(const SymbolId name) {
+    if (const auto stack = bindings(name); stack && stack->back().level == level()) {
+        return stack->back().symbol;
     }
 
     return {};
 }
 
-SemanticAnalyzer::SemanticAnalyzer(const char* fn) : fileName(fn) {
+std::vector<ScopeTracker::Binding>* ScopeTracker::bindings(const SymbolId name) {
+    const auto id = static_cast<size_t>(name);
+
+    if (id < symbolTable.size() && !symbolTable[id].empty()) {
+        return &symbolTable[id];
+    }
+
+    return nullptr;
 }
 
-void SemanticAnalyzer::analyze(const ExprPtr& ast) {
-    auto next = ast;
+SemanticAnalyzer::SemanticAnalyzer(const char* fn, Arena& arena) : paramPlaceholder(arena.make<DoubleExpr>(0.0)),
+                                                                   arena(arena), fileName(fn) {
+}
 
-    symbolTracker.enter("global");
-    while (next != nullptr) {
-        exprResolve(next);
-        next = next->child;
+void SemanticAnalyzer::analyze(Program& program) {
+    symbolTracker.enter(symbol::intern("global"));
+    for (auto& form: program.forms) {
+        exprResolve(form.expr);
     }
     symbolTracker.exit();
 }
 
-ExprPtr SemanticAnalyzer::exprResolve(const ExprPtr& ast) {
-    if (auto binop = cast::toBinop(ast)) {
-        return binopResolve(*binop);
-    } else if (const auto dotimes = cast::toDotimes(ast)) {
-        return dotimesResolve(*dotimes);
-    } else if (const auto loop = cast::toLoop(ast)) {
-        return loopResolve(*loop);
-    } else if (const auto let = cast::toLet(ast)) {
-        return letResolve(*let);
-    } else if (const auto setq = cast::toSetq(ast)) {
-        return setqResolve(*setq);
-    } else if (const auto defvar = cast::toDefvar(ast)) {
-        defvarResolve(*defvar);
-    } else if (const auto defconst = cast::toDefconstant(ast)) {
-        defconstResolve(*defconst);
-    } else if (cast::toDefun(ast)) {
-        return defunResolve(ast);
-    } else if (const auto funcCall = cast::toFuncCall(ast)) {
-        return funcCallResolve(*funcCall);
-    } else if (const auto return_ = cast::toReturn(ast)) {
-        returnResolve(*return_);
-    } else if (const auto if_ = cast::toIf(ast)) {
-        return ifResolve(*if_);
-    } else if (const auto when = cast::toWhen(ast)) {
-        return whenResolve(*when);
-    } else if (const auto cond = cast::toCond(ast)) {
-        return condResolve(*cond);
-    } else if (cast::toInt(ast) || cast::toDouble(ast) || cast::toVar(ast)) {
-        if (cast::toVar(ast)) {
-            return varResolve(const_cast<ExprPtr&>(ast), TokenType::VAR);
+ExprPtr SemanticAnalyzer::exprResolve(ExprPtr& ast) {
+    if (!ast) return nullptr;
+    return recursion::guard([&]() -> ExprPtr {
+        switch (ast->kind) {
+            case ExprKind::BINOP:
+                return binopResolve(*cast::toBinop(ast));
+            case ExprKind::DOTIMES:
+                return dotimesResolve(*cast::toDotimes(ast));
+            case ExprKind::LOOP:
+                return loopResolve(*cast::toLoop(ast));
+            case ExprKind::LET:
+                return letResolve(*cast::toLet(ast));
+            case ExprKind::SETQ:
+                return setqResolve(*cast::toSetq(ast));
+            case ExprKind::DEFVAR:
+                defvarResolve(*cast::toDefvar(ast));
+                break;
+            case ExprKind::DEFCONST:
+                defconstResolve(*cast::toDefconstant(ast));
+                break;
+            case ExprKind::DEFUN:
+                tfCtx.definitions.emplace(cast::toVar(cast::toDefun(ast)->name)->name, clone(arena, ast));
+                return defunResolve(ast);
+            case ExprKind::FUNCCALL:
+                return funcCallResolve(*cast::toFuncCall(ast));
+            case ExprKind::RETURN:
+                returnResolve(*cast::toReturn(ast));
+                break;
+            case ExprKind::IF:
+                return ifResolve(*cast::toIf(ast));
+            case ExprKind::WHEN:
+                return whenResolve(*cast::toWhen(ast));
+            case ExprKind::COND:
+                return condResolve(*cast::toCond(ast));
+            case ExprKind::VAR:
+                return varResolve(ast, TokenType::VAR);
+            case ExprKind::INT:
+            case ExprKind::DOUBLE:
+                return ast;
+            default:
+                break;
         }
 
-        return ast;
-    }
-
-    return nullptr;
+        return nullptr;
+    });
 }
 
 ExprPtr SemanticAnalyzer::binopResolve(BinOpExpr& binop) {
     ExprPtr lhs = nodeResolve(binop.lhs, binop.opToken.type);
     ExprPtr rhs = nodeResolve(binop.rhs, binop.opToken.type);
 
-    if (cast::toDouble(lhs)) {
+    if (cast::toDouble(lhs) && lhs != paramPlaceholder) {
         return lhs;
     }
 
     if (cast::toDouble(rhs)) {
         return rhs;
     }
-
-    return lhs;
+    // Either operand may still be an untyped param
+    return lhs ? lhs : rhs;
 }
 
-ExprPtr SemanticAnalyzer::dotimesResolve(const DotimesExpr& dotimes) {
-    symbolTracker.enter("");
+ExprPtr SemanticAnalyzer::dotimesResolve(DotimesExpr& dotimes) {
+    symbolTracker.enter();
     checkConstantVar(dotimes.iterationCount);
 
     const auto var = cast::toVar(dotimes.iterationCount);
@@ -170,8 +170,8 @@ ExprPtr SemanticAnalyzer::dotimesResolve(const DotimesExpr& dotimes) {
     // If it's expr, resolve it.
     valueResolve(var);
 
-    ExprPtr result;
-    for (const auto& statement: dotimes.statements) {
+    ExprPtr result{};
+    for (auto& statement: dotimes.statements) {
         result = exprResolve(statement);
     }
     symbolTracker.exit();
@@ -179,25 +179,25 @@ ExprPtr SemanticAnalyzer::dotimesResolve(const DotimesExpr& dotimes) {
     return result;
 }
 
-ExprPtr SemanticAnalyzer::loopResolve(const LoopExpr& loop) {
-    ExprPtr result;
+ExprPtr SemanticAnalyzer::loopResolve(LoopExpr& loop) {
+    ExprPtr result{};
 
-    for (const auto& sexpr: loop.sexprs) {
+    for (auto& sexpr: loop.sexprs) {
         result = exprResolve(sexpr);
     }
 
     return result;
 }
 
-ExprPtr SemanticAnalyzer::letResolve(const LetExpr& let) {
-    symbolTracker.enter("");
+ExprPtr SemanticAnalyzer::letResolve(LetExpr& let) {
+    symbolTracker.enter();
     for (const auto& var: let.bindings) {
         const auto var_ = cast::toVar(var);
-        const std::string varName = cast::toString(var_->name)->data;
+        const SymbolId varName = var_->name;
 
         // Check out the var in the current scope, if it's already defined, raise error
         if (const Symbol sym = symbolTracker.lookupCurrent(varName); sym.value) {
-            throw SemanticError(fileName, ERROR(MULTIPLE_DECL_ERROR, varName), 0);
+            throw SemanticError(fileName, ERROR(MULTIPLE_DECL_ERROR, symbol::name(varName)), 0);
         }
 
         // Check the value.If it's another var, look up all scopes.If it's not defined, raise error.
@@ -205,8 +205,8 @@ ExprPtr SemanticAnalyzer::letResolve(const LetExpr& let) {
         valueResolve(var_);
     }
 
-    ExprPtr result;
-    for (const auto& statement: let.body) {
+    ExprPtr result{};
+    for (auto& statement: let.body) {
         result = exprResolve(statement);
     }
 
@@ -219,13 +219,13 @@ ExprPtr SemanticAnalyzer::setqResolve(const SetqExpr& setq) {
     checkConstantVar(setq.pair);
 
     const auto var = cast::toVar(setq.pair);
-    const std::string varName = cast::toString(var->name)->data;
+    const SymbolId varName = var->name;
 
     // Check out the var.If it's not defined, raise error.
     const Symbol sym = symbolTracker.lookup(varName);
 
     if (!sym.value) {
-        throw SemanticError(fileName, ERROR(UNBOUND_VAR_ERROR, varName), 0);
+        throw SemanticError(fileName, ERROR(UNBOUND_VAR_ERROR, symbol::name(varName)), 0);
     }
     // Resolve the var scope.
     var->sType = sym.sType;
@@ -237,10 +237,10 @@ ExprPtr SemanticAnalyzer::setqResolve(const SetqExpr& setq) {
 
 void SemanticAnalyzer::defvarResolve(const DefvarExpr& defvar) {
     const auto var = cast::toVar(defvar.pair);
-    const std::string varName = cast::toString(var->name)->data;
+    const SymbolId varName = var->name;
 
     if (symbolTracker.level() > 1) {
-        throw SemanticError(fileName, ERROR(GLOBAL_VAR_DECL_ERROR, varName), 0);
+        throw SemanticError(fileName, ERROR(GLOBAL_VAR_DECL_ERROR, symbol::name(varName)), 0);
     }
 
     valueResolve(var);
@@ -248,10 +248,10 @@ void SemanticAnalyzer::defvarResolve(const DefvarExpr& defvar) {
 
 void SemanticAnalyzer::defconstResolve(const DefconstExpr& defconst) {
     const auto var = cast::toVar(defconst.pair);
-    const std::string varName = cast::toString(var->name)->data;
+    const SymbolId varName = var->name;
 
     if (symbolTracker.level() > 1) {
-        throw SemanticError(fileName, ERROR(CONSTANT_VAR_DECL_ERROR, varName), 0);
+        throw SemanticError(fileName, ERROR(CONSTANT_VAR_DECL_ERROR, symbol::name(varName)), 0);
     }
 
     valueResolve(var, true);
@@ -260,19 +260,19 @@ void SemanticAnalyzer::defconstResolve(const DefconstExpr& defconst) {
 ExprPtr SemanticAnalyzer::defunResolve(const ExprPtr& defun) {
     const auto func = cast::toDefun(defun);
     const auto var = cast::toVar(func->name);
-    const std::string funcName = cast::toString(var->name)->data;
+    const SymbolId funcName = var->name;
 
     symbolTracker.bind(funcName, {.name = funcName, .value = defun, .sType = SymbolType::GLOBAL});
 
     symbolTracker.enter(funcName);
     for (const auto& arg: func->args) {
         const auto argVar = cast::toVar(arg);
-        const std::string argName = cast::toString(argVar->name)->data;
-        symbolTracker.bind(argName, {.name = argName, .value = arg, .sType = argVar->sType});
+        const SymbolId argName = argVar->name;
+        symbolTracker.declare(argName, {.name = argName, .value = arg, .sType = argVar->sType});
     }
 
-    ExprPtr result;
-    for (const auto& statement: func->forms) {
+    ExprPtr result{};
+    for (auto& statement: func->forms) {
         result = exprResolve(statement);
     }
     symbolTracker.exit(true);
@@ -282,9 +282,10 @@ ExprPtr SemanticAnalyzer::defunResolve(const ExprPtr& defun) {
 
 ExprPtr SemanticAnalyzer::funcCallResolve(FuncCallExpr& funcCall, bool isParam) {
     const auto var = cast::toVar(funcCall.name);
-    const std::string funcName = cast::toString(var->name)->data;
+    const SymbolId funcName = var->name;
 
-    if (!isParam && symbolTracker.level() == 1) {
+    const bool isEntry = !isParam && symbolTracker.level() == 1;
+    if (isEntry) {
         tfCtx.isStarted = true;
         tfCtx.entryPoint = funcName;
     }
@@ -292,13 +293,15 @@ ExprPtr SemanticAnalyzer::funcCallResolve(FuncCallExpr& funcCall, bool isParam)
     Symbol sym = symbolTracker.lookup(funcName);
 
     if (!sym.value || !cast::toDefun(sym.value)) {
-        throw SemanticError(fileName, ERROR(FUNC_UNDEFINED_ERROR, funcName), 0);
+        throw SemanticError(fileName, ERROR(FUNC_UNDEFINED_ERROR, symbol::name(funcName)), 0);
     }
 
     const auto func = cast::toDefun(sym.value);
 
     if (funcCall.args.size() != func->args.size()) {
-        throw SemanticError(fileName, ERROR(FUNC_INVALID_NUMBER_OF_ARGS_ERROR, funcName, funcCall.args.size()), 0);
+        throw SemanticError(fileName,
+                            ERROR(FUNC_INVALID_NUMBER_OF_ARGS_ERROR, symbol::name(funcName), funcCall.args.size()),
+                            0);
     }
 
     // Match the param names to values
@@ -311,14 +314,15 @@ ExprPtr SemanticAnalyzer::funcCallResolve(FuncCallExpr& funcCall, bool isParam)
             for (size_t i = 0; i < func->args.size(); ++i) {
                 const auto fArg = cast::toVar(func->args[i]);
 
-                ExprPtr name = fArg->name;
                 ExprPtr value = funcCall.args[i];
 
-                funcCall.args[i] = std::make_shared<VarExpr>(name, value, fArg->sType);
+                funcCall.args[i] = arena.make<VarExpr>(fArg->name, value, fArg->sType);
             }
         }
     }
     // Type Resolution Phase
+    // Args computed from untyped params only have placeholder types
+    bool isUntyped{false};
     for (const auto& arg: funcCall.args) {
         auto argVar = cast::toVar(arg);
 
@@ -326,15 +330,16 @@ ExprPtr SemanticAnalyzer::funcCallResolve(FuncCallExpr& funcCall, bool isParam)
             setType(*argVar, argVar->value);
         } else if (auto binop = cast::toBinop(argVar->value)) {
             auto value = binopResolve(*binop);
+            isUntyped |= value == paramPlaceholder;
             setType(*argVar, value);
         } else if (auto fc = cast::toFuncCall(argVar->value)) {
-            auto value = funcCallResolve(*fc, true);
+            auto value = recursion::guard([&] { return funcCallResolve(*fc, true); });
             setType(*argVar, value);
         } else if (auto innerVar = cast::toVar(argVar->value)) {
             bool found{false};
 
             do {
-                const std::string innerVarName = cast::toString(innerVar->name)->data;
+                const SymbolId innerVarName = innerVar->name;
 
                 sym = symbolTracker.lookup(innerVarName);
 
@@ -380,43 +385,84 @@ ExprPtr SemanticAnalyzer::funcCallResolve(FuncCallExpr& funcCall, bool isParam)
         }
     };
 
-    if (tfCtx.isStarted) {
-        for (size_t i = 0; i < funcCall.args.size(); ++i) {
-            auto arg = cast::toVar(funcCall.args[i]);
-            makeLocal(*arg);
-            func->args[i] = funcCall.args[i];
+    // Calls with untyped args are left to the definition rather than specialized on placeholders
+    if (tfCtx.isStarted && !isUntyped) {
+        std::vector<VarType> signature;
+        signature.reserve(funcCall.args.size());
+        for (const auto& arg: funcCall.args) {
+            const auto argVar = cast::toVar(arg);
+            makeLocal(*argVar);
+            signature.push_back(argVar->vType);
         }
-        // Find the proper type of variables and the return type of the function
-        if (std::string& currentScope = symbolTracker.scopeName(); currentScope != funcName) {
-            funcCall.returnType = defunResolve(func);
-
-            if (funcName == tfCtx.entryPoint)
-                tfCtx.isStarted = false;
+        // Find the proper type of variables and the return type of the function.
+        // Every argument signature gets its own copy of the function, resolved once.
+        // The entry is added before resolving so that recursive calls stop there.
+        auto key = std::make_pair(funcName, std::move(signature));
+        auto it = tfCtx.specializations.find(key);
+
+        if (it == tfCtx.specializations.end()) {
+            const auto defun = specialize(*func, key.second);
+            it = tfCtx.specializations.emplace(key, defun).first;
+
+            for (size_t i = 0; i < funcCall.args.size(); ++i) {
+                defun->args[i] = funcCall.args[i];
+            }
+            defun->returnType = defunResolve(defun);
         }
+
+        funcCall.callee = it->second;
+    }
+
+    if (isEntry)
+        tfCtx.isStarted = false;
+
+    // Recursive calls get here before their callee is resolved and stay untyped
+    return funcCall.callee ? cast::toDefun(funcCall.callee)->returnType : nullptr;
+}
+
+// Letter of each VarType in the names of specializations
+static constexpr char typeCodes[] = {'u', 'i', 'd', 's', 'n', 't'};
+
+DefunExpr* SemanticAnalyzer::specialize(DefunExpr& func, const std::vector<VarType>& signature) {
+    const SymbolId funcName = cast::toVar(func.name)->name;
+
+    // The first signature seen keeps the definition and its name
+    if (const auto it = tfCtx.specializations.lower_bound({funcName, {}});
+        it == tfCtx.specializations.end() || it->first.first != funcName) {
+        return &func;
+    }
+
+    std::string name = symbol::name(funcName) + ".";
+    for (const auto type: signature) {
+        name += typeCodes[static_cast<int>(type)];
     }
 
-    return funcCall.returnType;
+    const auto copy = cast::toDefun(clone(arena, tfCtx.definitions.at(funcName)));
+    cast::toVar(copy->name)->name = symbol::intern(name);
+    func.specializations.push_back(copy);
+
+    return copy;
 }
 
 void SemanticAnalyzer::returnResolve(const ReturnExpr& return_) {
     if (cast::toT(return_.arg) || cast::toNIL(return_.arg)) return;
 
     const auto arg = cast::toVar(return_.arg);
-    const std::string argName = cast::toString(arg->name)->data;
+    const SymbolId argName = arg->name;
 
     // Check out the var.If it's not defined, raise error.
     if (const Symbol sym = symbolTracker.lookup(argName); !sym.value) {
-        throw SemanticError(fileName, ERROR(UNBOUND_VAR_ERROR, argName), 0);
+        throw SemanticError(fileName, ERROR(UNBOUND_VAR_ERROR, symbol::name(argName)), 0);
     }
 }
 
 ExprPtr SemanticAnalyzer::ifResolve(IfExpr& if_) {
     if (const auto test = cast::toVar(if_.test)) {
-        const std::string name = cast::toString(test->name)->data;
+        const SymbolId name = test->name;
 
         const Symbol sym = symbolTracker.lookup(name);
         if (!sym.value) {
-            throw SemanticError(fileName, ERROR(UNBOUND_VAR_ERROR, name), 0);
+            throw SemanticError(fileName, ERROR(UNBOUND_VAR_ERROR, symbol::name(name)), 0);
         }
 
         if_.test = sym.value;
@@ -426,8 +472,11 @@ ExprPtr SemanticAnalyzer::ifResolve(IfExpr& if_) {
 
     ExprPtr result = exprResolve(if_.then);
 
+    // A branch that only recurses leaves the type to the other one
     if (!cast::toUninitialized(if_.else_)) {
-        result = exprResolve(if_.else_);
+        if (const ExprPtr else_ = exprResolve(if_.else_)) {
+            result = else_;
+        }
     }
 
     return result;
@@ -435,11 +484,11 @@ ExprPtr SemanticAnalyzer::ifResolve(IfExpr& if_) {
 
 ExprPtr SemanticAnalyzer::whenResolve(WhenExpr& when) {
     if (const auto test = cast::toVar(when.test)) {
-        const std::string name = cast::toString(test->name)->data;
+        const SymbolId name = test->name;
 
         const Symbol sym = symbolTracker.lookup(name);
         if (!sym.value) {
-            throw SemanticError(fileName, ERROR(UNBOUND_VAR_ERROR, name), 0);
+            throw SemanticError(fileName, ERROR(UNBOUND_VAR_ERROR, symbol::name(name)), 0);
         }
 
         when.test = sym.value;
@@ -447,8 +496,8 @@ ExprPtr SemanticAnalyzer::whenResolve(WhenExpr& when) {
         exprResolve(when.test);
     }
 
-    ExprPtr result;
-    for (const auto& form: when.then) {
+    ExprPtr result{};
+    for (auto& form: when.then) {
         result = exprResolve(form);
     }
 
@@ -456,15 +505,15 @@ ExprPtr SemanticAnalyzer::whenResolve(WhenExpr& when) {
 }
 
 ExprPtr SemanticAnalyzer::condResolve(CondExpr& cond) {
-    ExprPtr result;
+    ExprPtr result{};
 
     for (auto& [test, statements]: cond.variants) {
         if (const auto test_ = cast::toVar(test)) {
-            const std::string name = cast::toString(test_->name)->data;
+            const SymbolId name = test_->name;
 
             const Symbol sym = symbolTracker.lookup(name);
             if (!sym.value) {
-                throw SemanticError(fileName, ERROR(UNBOUND_VAR_ERROR, name), 0);
+                throw SemanticError(fileName, ERROR(UNBOUND_VAR_ERROR, symbol::name(name)), 0);
             }
 
             test = sym.value;
@@ -472,7 +521,7 @@ ExprPtr SemanticAnalyzer::condResolve(CondExpr& cond) {
             exprResolve(test);
         }
 
-        for (const auto& statement: statements) {
+        for (auto& statement: statements) {
             result = exprResolve(statement);
         }
     }
@@ -482,10 +531,10 @@ ExprPtr SemanticAnalyzer::condResolve(CondExpr& cond) {
 
 void SemanticAnalyzer::checkConstantVar(const ExprPtr& var) {
     const auto var_ = cast::toVar(var);
-    const std::string varName = cast::toString(var_->name)->data;
+    const SymbolId varName = var_->name;
 
     if (const Symbol sym = symbolTracker.lookup(varName); sym.isConstant) {
-        throw SemanticError(fileName, ERROR(CONSTANT_VAR_ERROR, varName), 0);
+        throw SemanticError(fileName, ERROR(CONSTANT_VAR_ERROR, symbol::name(varName)), 0);
     }
 }
 
@@ -535,24 +584,26 @@ std::variant<int, double> SemanticAnalyzer::getValue(const ExprPtr& num) const {
 
 ExprPtr SemanticAnalyzer::returnValue(const VarExpr& var) {
     if (var.vType == VarType::INT) {
-        return std::make_shared<IntExpr>(0);
+        return arena.make<IntExpr>(0);
     }
 
     if (var.vType == VarType::DOUBLE) {
-        return std::make_shared<DoubleExpr>(0.0);
+        return arena.make<DoubleExpr>(0.0);
     }
 
     if (var.vType == VarType::STRING) {
-        return std::make_shared<StringExpr>();
+        return arena.make<StringExpr>();
     }
 
     if (var.vType == VarType::NIL) {
-        return std::make_shared<NILExpr>();
+        return arena.make<NILExpr>();
     }
 
     if (var.vType == VarType::T) {
-        return std::make_shared<TExpr>();
+        return arena.make<TExpr>();
     }
+
+    return nullptr;
 }
 
 ExprPtr SemanticAnalyzer::varResolve(ExprPtr& n, const TokenType ttype) {
@@ -568,12 +619,12 @@ ExprPtr SemanticAnalyzer::varResolve(ExprPtr& n, const TokenType ttype) {
     checkBool(n, ttype);
 
     const auto var = cast::toVar(n);
-    const std::string name = cast::toString(var->name)->data;
+    const SymbolId name = var->name;
 
     const Symbol sym = symbolTracker.lookup(name);
 
     if (!sym.value) {
-        throw SemanticError(fileName, ERROR(UNBOUND_VAR_ERROR, name), 0);
+        throw SemanticError(fileName, ERROR(UNBOUND_VAR_ERROR, symbol::name(name)), 0);
     }
 
     var->sType = sym.sType;
@@ -595,11 +646,11 @@ ExprPtr SemanticAnalyzer::varResolve(ExprPtr& n, const TokenType ttype) {
                 checkBitwiseOp(innerVar->value, ttype);
             }
 
-            ExprPtr value_;
+            ExprPtr value_{};
             if (innerVar->vType == VarType::INT) {
-                value_ = std::make_shared<IntExpr>(0);
+                value_ = arena.make<IntExpr>(0);
             } else if (innerVar->vType == VarType::DOUBLE) {
-                value_ = std::make_shared<DoubleExpr>(0.0);
+                value_ = arena.make<DoubleExpr>(0.0);
             }
             var->value = value_;
             var->vType = innerVar->vType;
@@ -621,35 +672,36 @@ ExprPtr SemanticAnalyzer::varResolve(ExprPtr& n, const TokenType ttype) {
         }
         // If the value is param
         if (cast::toUninitialized(innerVar->value)) {
-            var->value = std::make_shared<DoubleExpr>(0.0);;
-            return var->value;
+            var->value = arena.make<DoubleExpr>(0.0);
+            return paramPlaceholder;
         }
 
         innerVar = cast::toVar(innerVar->value);
     } while (innerVar);
 
     if (!innerVar) {
-        throw SemanticError(fileName, ERROR(UNBOUND_VAR_ERROR, name), 0);
+        throw SemanticError(fileName, ERROR(UNBOUND_VAR_ERROR, symbol::name(name)), 0);
     }
 
     return nullptr;
 }
 
 ExprPtr SemanticAnalyzer::nodeResolve(ExprPtr& n, const TokenType ttype) {
-    if (const auto binop = cast::toBinop(n)) {
-        return binopResolve(*binop);
-    }
-
-    if (const auto funcCall = cast::toFuncCall(n)) {
-        return funcCallResolve(*funcCall);
-    }
-
-    return varResolve(n, ttype);
+    return recursion::guard([&]() -> ExprPtr {
+        switch (n->kind) {
+            case ExprKind::BINOP:
+                return binopResolve(*cast::toBinop(n));
+            case ExprKind::FUNCCALL:
+                return funcCallResolve(*cast::toFuncCall(n));
+            default:
+                return varResolve(n, ttype);
+        }
+    });
 }
 
 ExprPtr SemanticAnalyzer::valueResolve(const ExprPtr& var, const bool isConstant) {
     const auto var_ = cast::toVar(var);
-    const std::string varName = cast::toString(var_->name)->data;
+    const SymbolId varName = var_->name;
 
     if (isPrimitive(var_->value) || cast::toUninitialized(var_->value)) {
         setType(*var_, var_->value);
@@ -664,11 +716,11 @@ ExprPtr SemanticAnalyzer::valueResolve(const ExprPtr& var, const bool isConstant
     }
 
     if (const auto value = cast::toVar(var_->value)) {
-        const std::string valueName = cast::toString(value->name)->data;
+        const SymbolId valueName = value->name;
         const Symbol sym = symbolTracker.lookup(valueName);
 
         if (!sym.value) {
-            throw SemanticError(fileName, ERROR(UNBOUND_VAR_ERROR, varName), 0);
+            throw SemanticError(fileName, ERROR(UNBOUND_VAR_ERROR, symbol::name(varName)), 0);
         }
         // Update value
         var_->value = sym.value;
@@ -683,7 +735,6 @@ ExprPtr SemanticAnalyzer::valueResolve(const ExprPtr& var, const bool isConstant
         return var_->value;
     }
 
-    ExprPtr name = var_->name;
     ExprPtr value_ = exprResolve(var_->value);
     var_->vType = cast::toInt(value_) ? VarType::INT : VarType::DOUBLE;
 
@@ -698,15 +749,25 @@ ExprPtr SemanticAnalyzer::valueResolve(const ExprPtr& var, const bool isConstant
 }
 
 void SemanticAnalyzer::setType(VarExpr& var, const ExprPtr& value) {
-    if (cast::toInt(value)) {
-        var.vType = VarType::INT;
-    } else if (cast::toDouble(value)) {
-        var.vType = VarType::DOUBLE;
-    } else if (cast::toString(value)) {
-        var.vType = VarType::STRING;
-    } else if (cast::toT(value)) {
-        var.vType = VarType::T;
-    } else if (cast::toNIL(value)) {
-        var.vType = VarType::NIL;
+    if (!value) return;
+
+    switch (value->kind) {
+        case ExprKind::INT:
+            var.vType = VarType::INT;
+            break;
+        case ExprKind::DOUBLE:
+            var.vType = VarType::DOUBLE;
+            break;
+        case ExprKind::STRING:
+            var.vType = VarType::STRING;
+            break;
+        case ExprKind::T:
+            var.vType = VarType::T;
+            break;
+        case ExprKind::NIL:
+            var.vType = VarType::NIL;
+            break;
+        default:
+            break;
     }
 }
@@ -1,59 +1,77 @@
 #ifndef SEMANTIC_H
 #define SEMANTIC_H
 
+#include <map>
 #include <stack>
 #include <unordered_map>
+#include <vector>
 #include "parser.h"
 
 struct Symbol {
-    std::string name;
-    ExprPtr value;
+    SymbolId name;
+    ExprPtr value{};
     SymbolType sType;
     bool isConstant{};
 };
 
+// Every symbol has a stack of its live bindings, innermost last. Scopes record
+// which symbols they bound, so leaving a scope pops just those bindings.
 class ScopeTracker {
 public:
-    void enter(const std::string& scopeName);
+    void enter();
+
+    void enter(SymbolId scopeName);
 
     void exit(bool isFunc = false);
 
-    [[nodiscard]] std::string& scopeName();
+    [[nodiscard]] SymbolId scopeName() const;
 
     [[nodiscard]] size_t level() const;
 
-    void bind(const std::string& name, const Symbol& symbol);
+    void bind(SymbolId name, const Symbol& symbol);
+
+    void declare(SymbolId name, const Symbol& symbol);
 
-    void update(const std::string& name, const Symbol& symbol);
+    void update(SymbolId name, const Symbol& symbol);
 
-    Symbol lookup(const std::string& name);
+    Symbol lookup(SymbolId name);
 
-    Symbol lookupCurrent(const std::string& name);
+    Symbol lookupCurrent(SymbolId name);
 
 private:
-    using ScopeType = std::unordered_map<std::string, Symbol>;
-    std::stack<ScopeType> symbolTable;
-    std::stack<std::string> scopeNames;
+    struct Binding {
+        Symbol symbol;
+        size_t level;
+    };
+
+    std::vector<Binding>* bindings(SymbolId name);
+
+    std::vector<std::vector<Binding> > symbolTable;
+    // Symbols bound so far, in binding order
+    std::vector<SymbolId> undoLog;
+    // Size of the undo log when each open scope was entered
+    std::vector<size_t> scopeStarts;
+    std::stack<SymbolId> scopeNames;
 };
 
 class SemanticAnalyzer {
 public:
-    explicit SemanticAnalyzer(const char* fn);
+    SemanticAnalyzer(const char* fn, Arena& arena);
 
-    void analyze(const ExprPtr& ast);
+    void analyze(Program& program);
 
 private:
     /* Name Resolutions */
 
-    ExprPtr exprResolve(const ExprPtr& ast);
+    ExprPtr exprResolve(ExprPtr& ast);
 
     ExprPtr binopResolve(BinOpExpr& binop);
 
-    ExprPtr dotimesResolve(const DotimesExpr& dotimes);
+    ExprPtr dotimesResolve(DotimesExpr& dotimes);
 
-    ExprPtr loopResolve(const LoopExpr& loop);
+    ExprPtr loopResolve(LoopExpr& loop);
 
-    ExprPtr letResolve(const LetExpr& let);
+    ExprPtr letResolve(LetExpr& let);
 
     ExprPtr setqResolve(const SetqExpr& setq);
 
@@ -95,21 +113,38 @@ private:
 
     ScopeTracker symbolTracker;
 
+    DefunExpr* specialize(DefunExpr& func, const std::vector<VarType>& signature);
+
     struct TypeInferenceContext {
         bool isStarted{false};
-        std::string entryPoint;
+        SymbolId entryPoint{};
+        // Functions as parsed, copied before any resolution
+        std::unordered_map<SymbolId, ExprPtr> definitions;
+        // Specializations by function and argument types
+        std::map<std::pair<SymbolId, std::vector<VarType> >, DefunExpr*> specializations;
     };
     TypeInferenceContext tfCtx;
+    // Value of params whose type is not known yet
+    const ExprPtr paramPlaceholder;
+    /* AST Nodes */
+    Arena& arena;
     /* File Name */
     const char* fileName;
 };
 
 inline bool SemanticAnalyzer::isPrimitive(const ExprPtr& var) {
-    return cast::toInt(var) ||
-           cast::toDouble(var) ||
-           cast::toNIL(var) ||
-           cast::toT(var) ||
-           cast::toString(var);
+    if (!var) return false;
+
+    switch (var->kind) {
+        case ExprKind::INT:
+        case ExprKind::DOUBLE:
+        case ExprKind::NIL:
+        case ExprKind::T:
+        case ExprKind::STRING:
+            return true;
+        default:
+            return false;
+    }
 }
 
 #endif //SEMANTIC_H
@@ -0,0 +1,72 @@
+#include "source.h"
+#include <cerrno>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SourceFile::SourceFile(const std::string& fn) {
+    if (fn == "-") {
+        read(STDIN_FILENO);
+        return;
+    }
+
+    const int fd = open(fn.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), fn);
+    }
+
+    struct stat st{};
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (addr != MAP_FAILED) {
+            madvise(addr, st.st_size, MADV_SEQUENTIAL);
+
+            data = static_cast<const char*>(addr);
+            size = st.st_size;
+            isMapped = true;
+
+            close(fd);
+            return;
+        }
+    }
+
+    // Not mappable (pipe, device, empty file), fall back to read()
+    try {
+        read(fd);
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+}
+
+SourceFile::~SourceFile() {
+    if (isMapped) {
+        munmap(const_cast<char*>(data), size);
+    }
+}
+
+void SourceFile::read(const int fd) {
+    char chunk[64 * 1024];
+
+    for (;;) {
+        const ssize_t n = ::read(fd, chunk, sizeof(chunk));
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            throw std::system_error(errno, std::generic_category(), "read");
+        }
+
+        if (n == 0)
+            break;
+
+        buffer.append(chunk, n);
+    }
+
+    data = buffer.data();
+    size = buffer.size();
+}
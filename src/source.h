@@ -0,0 +1,30 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <string>
+#include <string_view>
+
+// Source text of a compilation. Regular files are memory-mapped and scanned in place,
+// pipes and stdin ("-") are read into a buffer.
+class SourceFile {
+public:
+    explicit SourceFile(const std::string& fn);
+
+    ~SourceFile();
+
+    SourceFile(const SourceFile&) = delete;
+
+    SourceFile& operator=(const SourceFile&) = delete;
+
+    [[nodiscard]] std::string_view text() const { return {data, size}; }
+
+private:
+    void read(int fd);
+
+    const char* data{};
+    size_t size{0};
+    bool isMapped{false};
+    std::string buffer;
+};
+
+#endif //SOURCE_H
@@ -0,0 +1,27 @@
+#include "symbol.h"
+#include <deque>
+#include <unordered_map>
+
+namespace symbol {
+// Deque keeps the strings in place, so the views used as keys stay valid
+static std::deque<std::string> names;
+static std::unordered_map<std::string_view, SymbolId> ids;
+
+SymbolId intern(const std::string_view name) {
+    if (const auto it = ids.find(name); it != ids.end())
+        return it->second;
+
+    const auto id = static_cast<SymbolId>(names.size());
+    ids.emplace(names.emplace_back(name), id);
+
+    return id;
+}
+
+const std::string& name(const SymbolId id) {
+    return names[static_cast<size_t>(id)];
+}
+
+size_t count() {
+    return names.size();
+}
+}
@@ -0,0 +1,21 @@
+#ifndef SYMBOL_H
+#define SYMBOL_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Dense id of an interned name. Names are interned once, when the lexer
+// first sees them, and every later pass keys on the id.
+enum class SymbolId : uint32_t {};
+
+namespace symbol {
+SymbolId intern(std::string_view name);
+
+const std::string& name(SymbolId id);
+
+// Number of ids handed out so far; ids are in [0, count())
+size_t count();
+}
+
+#endif //SYMBOL_H